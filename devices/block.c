@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include "devices/ide.h"
 #include "threads/malloc.h"
+#include "threads/trace.h"
 
 /* A block device. */
 struct block
@@ -121,6 +122,7 @@ void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
   check_sector (block, sector);
+  TRACE (BLOCK_READ, block->type, sector);
   block->ops->read (block->aux, sector, buffer);
   block->read_cnt++;
 }
@@ -135,10 +137,61 @@ block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
   check_sector (block, sector);
   ASSERT (block->type != BLOCK_FOREIGN);
+  TRACE (BLOCK_WRITE, block->type, sector);
   block->ops->write (block->aux, sector, buffer);
   block->write_cnt++;
 }
 
+/* Reads CNT sectors starting at SECTOR from BLOCK into BUFFER,
+   which must have room for CNT * BLOCK_SECTOR_SIZE bytes, as a
+   single request if the driver supports it.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_sectors (struct block *block, block_sector_t sector, size_t cnt,
+                    void *buffer)
+{
+  uint8_t *p = buffer;
+  size_t i;
+
+  ASSERT (cnt > 0);
+  check_sector (block, sector);
+  check_sector (block, sector + cnt - 1);
+  TRACE (BLOCK_READ, block->type, sector);
+  if (block->ops->read_sectors != NULL)
+    block->ops->read_sectors (block->aux, sector, cnt, buffer);
+  else
+    for (i = 0; i < cnt; i++)
+      block->ops->read (block->aux, sector + i, p + i * BLOCK_SECTOR_SIZE);
+  block->read_cnt += cnt;
+}
+
+/* Writes CNT sectors starting at SECTOR to BLOCK from BUFFER,
+   which must contain CNT * BLOCK_SECTOR_SIZE bytes, as a single
+   request if the driver supports it.  Returns after the block
+   device has acknowledged receiving the data.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_sectors (struct block *block, block_sector_t sector, size_t cnt,
+                     const void *buffer)
+{
+  const uint8_t *p = buffer;
+  size_t i;
+
+  ASSERT (cnt > 0);
+  check_sector (block, sector);
+  check_sector (block, sector + cnt - 1);
+  ASSERT (block->type != BLOCK_FOREIGN);
+  TRACE (BLOCK_WRITE, block->type, sector);
+  if (block->ops->write_sectors != NULL)
+    block->ops->write_sectors (block->aux, sector, cnt, buffer);
+  else
+    for (i = 0; i < cnt; i++)
+      block->ops->write (block->aux, sector + i, p + i * BLOCK_SECTOR_SIZE);
+  block->write_cnt += cnt;
+}
+
 /* Returns the number of sectors in BLOCK. */
 block_sector_t
 block_size (struct block *block)
@@ -9,6 +9,7 @@
 #include "threads/io.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
+#include "threads/workqueue.h"
 
 /* The code in this file is an interface to an ATA (IDE)
    controller.  It attempts to comply to [ATA-3]. */
@@ -71,10 +72,22 @@ struct channel
     bool expecting_interrupt;   /* True if an interrupt is expected, false if
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
+    struct work unexpected_work;        /* Reports a spurious interrupt. */
 
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
+/* Longest wait for a completion interrupt, in timer ticks.  A
+   timeout while identifying a disk just leaves that disk out.  A
+   timeout during a read or write is fatal: block_read() and
+   block_write() have no way to report an error, so the kernel
+   panics instead of hanging forever. */
+#define COMPLETION_TIMEOUT (30 * TIMER_FREQ)
+
+/* Most sectors one READ SECTOR or WRITE SECTOR command can
+   transfer, since the sector count register is 8 bits wide. */
+#define MAX_SECTORS 255
+
 /* We support the two "legacy" ATA channels found in a standard PC. */
 #define CHANNEL_CNT 2
 static struct channel channels[CHANNEL_CNT];
@@ -85,7 +98,7 @@ static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void select_sector (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -96,6 +109,7 @@ static void select_device (const struct ata_disk *);
 static void select_device_wait (const struct ata_disk *);
 
 static void interrupt_handler (struct intr_frame *);
+static work_func report_unexpected;
 
 /* Initialize the disk subsystem and detect disks. */
 void
@@ -124,8 +138,10 @@ ide_init (void)
           NOT_REACHED ();
         }
       lock_init (&c->lock);
+      lock_set_name (&c->lock, c->name);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      work_init (&c->unexpected_work, report_unexpected, c);
 
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -273,7 +289,19 @@ identify_ata_device (struct ata_disk *d)
      into our buffer. */
   select_device_wait (d);
   issue_pio_command (c, CMD_IDENTIFY_DEVICE);
-  sema_down (&c->completion_wait);
+  if (!sema_down_timeout (&c->completion_wait, COMPLETION_TIMEOUT))
+    {
+      /* Treat a late completion interrupt as spurious, and drop
+         one that arrived after the timeout fired, so that the next
+         command does not see it as its own. */
+      enum intr_level old_level = intr_disable ();
+      c->expecting_interrupt = false;
+      while (sema_try_down (&c->completion_wait))
+        continue;
+      intr_set_level (old_level);
+      d->is_ata = false;
+      return;
+    }
   if (!wait_while_busy (d))
     {
       d->is_ata = false;
@@ -337,63 +365,112 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
+/* Reads CNT sectors starting at SEC_NO from disk D into BUFFER,
+   which must have room for CNT * BLOCK_SECTOR_SIZE bytes.  Each
+   command transfers up to MAX_SECTORS sectors, with one
+   completion interrupt per sector.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+ide_read_sectors (void *d_, block_sector_t sec_no, size_t cnt, void *buffer)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  uint8_t *p = buffer;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
+  while (cnt > 0)
+    {
+      size_t n = cnt < MAX_SECTORS ? cnt : MAX_SECTORS;
+      size_t i;
+
+      select_sector (d, sec_no, n);
+      issue_pio_command (c, CMD_READ_SECTOR_RETRY);
+      for (i = 0; i < n; i++, sec_no++, p += BLOCK_SECTOR_SIZE)
+        {
+          if (!sema_down_timeout (&c->completion_wait, COMPLETION_TIMEOUT)
+              || !wait_while_busy (d))
+            PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
+          input_sector (c, p);
+        }
+      cnt -= n;
+    }
   lock_release (&c->lock);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
+/* Writes CNT sectors starting at SEC_NO to disk D from BUFFER,
+   which must contain CNT * BLOCK_SECTOR_SIZE bytes.  Returns
+   after the disk has acknowledged receiving the data.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+ide_write_sectors (void *d_, block_sector_t sec_no, size_t cnt,
+                   const void *buffer)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  const uint8_t *p = buffer;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
+  while (cnt > 0)
+    {
+      size_t n = cnt < MAX_SECTORS ? cnt : MAX_SECTORS;
+      size_t i;
+
+      select_sector (d, sec_no, n);
+      issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
+      for (i = 0; i < n; i++, sec_no++, p += BLOCK_SECTOR_SIZE)
+        {
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
+          output_sector (c, p);
+          if (!sema_down_timeout (&c->completion_wait, COMPLETION_TIMEOUT))
+            PANIC ("%s: disk write timed out, sector=%"PRDSNu,
+                   d->name, sec_no);
+        }
+      cnt -= n;
+    }
   lock_release (&c->lock);
 }
 
+/* Reads sector SEC_NO from disk D into BUFFER, which must have
+   room for BLOCK_SECTOR_SIZE bytes. */
+static void
+ide_read (void *d_, block_sector_t sec_no, void *buffer)
+{
+  ide_read_sectors (d_, sec_no, 1, buffer);
+}
+
+/* Write sector SEC_NO to disk D from BUFFER, which must contain
+   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
+   acknowledged receiving the data. */
+static void
+ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+{
+  ide_write_sectors (d_, sec_no, 1, buffer);
+}
+
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_sectors,
+    ide_write_sectors
   };
-
+
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the sector count CNT to the disk's sector
+   selection registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= MAX_SECTORS);
 
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -492,6 +569,16 @@ select_device (const struct ata_disk *d)
   timer_nsleep (400);
 }
 
+/* Reports a spurious interrupt on channel C_ from thread
+   context, since printing to the console is too slow to do from
+   the interrupt handler. */
+static void
+report_unexpected (void *c_)
+{
+  struct channel *c = c_;
+  printf ("%s: unexpected interrupt\n", c->name);
+}
+
 /* Select disk D in its channel, as select_device(), but wait for
    the channel to become idle before and after. */
 static void
@@ -517,7 +604,7 @@ interrupt_handler (struct intr_frame *f)
             sema_up (&c->completion_wait);      /* Wake up waiter. */
           }
         else
-          printf ("%s: unexpected interrupt\n", c->name);
+          work_queue (WORK_NORMAL, &c->unexpected_work);
         return;
       }
 
@@ -7,6 +7,7 @@
 #include "devices/shutdown.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/workqueue.h"
 
 /* Keyboard data register port. */
 #define DATA_REG 0x60
@@ -26,10 +27,15 @@ static int64_t key_cnt;
 
 static intr_handler_func keyboard_interrupt;
 
+/* Reboots the machine from thread context after Ctrl+Alt+Del. */
+static work_func reboot;
+static struct work reboot_work;
+
 /* Initializes the keyboard. */
 void
 kbd_init (void)
 {
+  work_init (&reboot_work, reboot, NULL);
   intr_register_ext (0x21, keyboard_interrupt, "8042 Keyboard");
 }
 
@@ -135,7 +141,7 @@ keyboard_interrupt (struct intr_frame *args UNUSED)
         {
           /* Reboot if Ctrl+Alt+Del pressed. */
           if (c == 0177 && ctrl && alt)
-            shutdown_reboot ();
+            work_queue (WORK_HIGH, &reboot_work);
 
           /* Handle Ctrl, Shift.
              Note that Ctrl overrides Shift. */
@@ -211,3 +217,10 @@ map_key (const struct keymap k[], unsigned scancode, uint8_t *c)
 
   return false;
 }
+
+/* Reboots the machine.  Queued by keyboard_interrupt(). */
+static void
+reboot (void *aux UNUSED)
+{
+  shutdown_reboot ();
+}
@@ -11,9 +11,6 @@
 #define PIT_PORT_CONTROL          0x43                /* Control port. */
 #define PIT_PORT_COUNTER(CHANNEL) (0x40 + (CHANNEL))  /* Counter port. */
 
-/* PIT cycles per second. */
-#define PIT_HZ 1193180
-
 /* Configure the given CHANNEL in the PIT.  In a PC, the PIT's
    three output channels are hooked up like this:
 
@@ -81,3 +78,62 @@ pit_configure_channel (int channel, int mode, int frequency)
   outb (PIT_PORT_COUNTER (channel), count >> 8);
   intr_set_level (old_level);
 }
+
+/* Starts CHANNEL counting down once from COUNT PIT cycles, in
+   mode 0 ("interrupt on terminal count"): the channel's output
+   goes low now and rises when the count reaches zero, which for
+   channel 0 raises a single timer interrupt.  The channel stays
+   quiet afterward until it is reconfigured.  A COUNT of 0 is
+   treated as 65536. */
+void
+pit_configure_oneshot (int channel, uint16_t count)
+{
+  enum intr_level old_level;
+
+  ASSERT (channel == 0);
+
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, (channel << 6) | 0x30);
+  outb (PIT_PORT_COUNTER (channel), count);
+  outb (PIT_PORT_COUNTER (channel), count >> 8);
+  intr_set_level (old_level);
+}
+
+/* Returns the number of PIT cycles left in CHANNEL's current
+   count.  Uses the counter latch command, so that the two bytes
+   come from the same instant. */
+uint16_t
+pit_read_count (int channel)
+{
+  enum intr_level old_level;
+  uint16_t count;
+
+  ASSERT (channel == 0 || channel == 2);
+
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, channel << 6);
+  count = inb (PIT_PORT_COUNTER (channel));
+  count |= inb (PIT_PORT_COUNTER (channel)) << 8;
+  intr_set_level (old_level);
+
+  return count;
+}
+
+/* Returns true if CHANNEL's output is high, as reported by the
+   8254 read-back command.  For a channel in one-shot mode, this
+   means its count has run out. */
+bool
+pit_output_high (int channel)
+{
+  enum intr_level old_level;
+  uint8_t status;
+
+  ASSERT (channel == 0 || channel == 2);
+
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, 0xe0 | (2 << channel));
+  status = inb (PIT_PORT_COUNTER (channel));
+  intr_set_level (old_level);
+
+  return (status & 0x80) != 0;
+}
@@ -4,8 +4,12 @@
 #include "devices/kbd.h"
 #include "devices/serial.h"
 #include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/profile.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
 #endif
@@ -13,6 +17,9 @@
 #include "devices/block.h"
 #include "filesys/filesys.h"
 #endif
+#ifdef VM
+#include "vm/zswap.h"
+#endif
 
 /* Keyboard control register port. */
 #define CONTROL_REG 0x64
@@ -130,6 +137,13 @@ print_stats (void)
 #ifdef FILESYS
   block_print_stats ();
 #endif
+#ifdef VM
+  zswap_print_stats ();
+#endif
+  lock_print_stats ();
+  intr_print_stats ();
+  profile_dump ();
+  workqueue_print_stats ();
   console_print_stats ();
   kbd_print_stats ();
 #ifdef USERPROG
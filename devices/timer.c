@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include "devices/pit.h"
 #include "threads/interrupt.h"
+#include "threads/profile.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
 
@@ -24,7 +25,41 @@ static int64_t ticks;
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* Threads blocked in timer_sleep(), in order of increasing
+   wakeup tick, so the timer interrupt only has to look at the
+   front of the list. */
+static struct list sleep_list;
+
+/* Armed timeouts, in order of increasing deadline. */
+static struct list timeout_list;
+
+/* Tickless idle.  If true, the idle thread stops the periodic
+   timer interrupt and programs a single interrupt for the next
+   deadline instead.  Controlled by kernel command-line option
+   "-tickless". */
+bool timer_tickless;
+
+/* PIT cycles per timer tick. */
+#define PIT_TICK_COUNT ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* Longest one-shot interval, in ticks, that fits in the PIT's
+   16-bit counter. */
+#define ONESHOT_MAX_TICKS (UINT16_MAX / PIT_TICK_COUNT)
+
+/* While the idle thread has the PIT in one-shot mode: the number
+   of ticks the one-shot interval covers and the PIT count it was
+   started with.  ONESHOT_TICKS is 0 while the timer is
+   periodic. */
+static int64_t oneshot_ticks;
+static uint16_t oneshot_count;
+
 static intr_handler_func timer_interrupt;
+static void timer_advance (int64_t n);
+static void timer_resume_periodic (void);
+static bool wakeup_less (const struct list_elem *, const struct list_elem *,
+                         void *aux);
+static bool deadline_less (const struct list_elem *, const struct list_elem *,
+                           void *aux);
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
@@ -36,6 +71,8 @@ void
 timer_init (void)
 {
   pit_configure_channel (0, 2, TIMER_FREQ);
+  list_init (&sleep_list);
+  list_init (&timeout_list);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
 
@@ -85,15 +122,62 @@ timer_elapsed (int64_t then)
 }
 
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
-   be turned on. */
+   be turned on.
+
+   The thread blocks until the timer interrupt wakes it, so it
+   uses no CPU time while asleep. */
 void
 timer_sleep (int64_t ticks)
 {
-  int64_t start = timer_ticks ();
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
 
   ASSERT (intr_get_level () == INTR_ON);
-  while (timer_elapsed (start) < ticks)
-    thread_yield ();
+  if (ticks <= 0)
+    return;
+
+  old_level = intr_disable ();
+  cur->wakeup_tick = timer_ticks () + ticks;
+  list_insert_ordered (&sleep_list, &cur->elem, wakeup_less, NULL);
+  thread_block ();
+  intr_set_level (old_level);
+}
+
+/* Arms timeout TO to call FUNC with AUX from the timer interrupt
+   at tick DEADLINE, or at the next tick if DEADLINE has already
+   passed.  TO must not already be armed.  FUNC runs in an
+   external interrupt context, so it must not sleep. */
+void
+timer_timeout_add (struct timeout *to, int64_t deadline,
+                   timeout_func *func, void *aux)
+{
+  enum intr_level old_level;
+
+  ASSERT (to != NULL);
+  ASSERT (func != NULL);
+
+  to->deadline = deadline;
+  to->func = func;
+  to->aux = aux;
+
+  old_level = intr_disable ();
+  to->armed = true;
+  list_insert_ordered (&timeout_list, &to->elem, deadline_less, NULL);
+  intr_set_level (old_level);
+}
+
+/* Disarms timeout TO if it has not fired yet.  Afterward, TO's
+   function will not be called and TO may be reused or freed. */
+void
+timer_timeout_cancel (struct timeout *to)
+{
+  enum intr_level old_level = intr_disable ();
+  if (to->armed)
+    {
+      list_remove (&to->elem);
+      to->armed = false;
+    }
+  intr_set_level (old_level);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -166,12 +250,171 @@ timer_print_stats (void)
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
 }
 
+/* Called by the idle thread, with interrupts off, just before
+   it halts the CPU.  In tickless mode, replaces the periodic
+   timer interrupt by a single interrupt at the next sleeper's
+   wakeup tick or timeout deadline, or as far ahead as the PIT
+   can count.  The one-shot interval keeps the phase of the
+   periodic tick. */
+void
+timer_idle_enter (void)
+{
+  int64_t n = ONESHOT_MAX_TICKS;
+  uint16_t left;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!timer_tickless || oneshot_ticks != 0)
+    return;
+
+  if (!list_empty (&sleep_list))
+    {
+      struct thread *t = list_entry (list_front (&sleep_list),
+                                     struct thread, elem);
+      if (t->wakeup_tick - ticks < n)
+        n = t->wakeup_tick - ticks;
+    }
+  if (!list_empty (&timeout_list))
+    {
+      struct timeout *to = list_entry (list_front (&timeout_list),
+                                       struct timeout, elem);
+      if (to->deadline - ticks < n)
+        n = to->deadline - ticks;
+    }
+  if (n <= 1)
+    return;
+
+  /* Cycles left in the current period, then whole periods. */
+  left = pit_read_count (0);
+  if (left == 0 || left > PIT_TICK_COUNT)
+    left = PIT_TICK_COUNT;
+  oneshot_count = left + (n - 1) * PIT_TICK_COUNT;
+  oneshot_ticks = n;
+  pit_configure_oneshot (0, oneshot_count);
+}
+
+/* Called by the idle thread, with interrupts off, after it wakes
+   up and before it lets another thread run.  If the one-shot
+   timer is still armed, accounts for the ticks that passed and
+   restarts the periodic timer interrupt.  The catching up is done
+   here, while the idle thread is still running, so that
+   thread_tick() charges the idle period to the idle thread and
+   not to whichever thread runs next. */
+void
+timer_idle_exit (void)
+{
+  int64_t elapsed;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (oneshot_ticks == 0)
+    return;
+
+  if (pit_output_high (0))
+    {
+      /* The count ran out, but another interrupt got in first and
+         the timer interrupt is still pending.  It will do the
+         last tick once the periodic timer is back. */
+      elapsed = oneshot_ticks - 1;
+    }
+  else
+    {
+      /* Round the cycles that went by to the nearest tick. */
+      elapsed = ((oneshot_count - pit_read_count (0))
+                 + PIT_TICK_COUNT / 2) / PIT_TICK_COUNT;
+      if (elapsed >= oneshot_ticks)
+        elapsed = oneshot_ticks - 1;
+    }
+  timer_resume_periodic ();
+  timer_advance (elapsed);
+}
+
 /* Timer interrupt handler. */
 static void
-timer_interrupt (struct intr_frame *args UNUSED)
+timer_interrupt (struct intr_frame *args)
 {
-  ticks++;
-  thread_tick ();
+  int64_t n = 1;
+
+  if (profile_enabled)
+    profile_sample (args);
+
+  if (oneshot_ticks != 0)
+    {
+      n = oneshot_ticks;
+      timer_resume_periodic ();
+    }
+  timer_advance (n);
+}
+
+/* Puts the PIT back into periodic mode after a one-shot
+   interval. */
+static void
+timer_resume_periodic (void)
+{
+  oneshot_ticks = 0;
+  pit_configure_channel (0, 2, TIMER_FREQ);
+}
+
+/* Advances the tick count by N ticks, doing the per-tick work for
+   each one.  N is more than 1 only when catching up after a
+   tickless idle period, during which only the idle thread ran. */
+static void
+timer_advance (int64_t n)
+{
+  while (n-- > 0)
+    {
+      ticks++;
+      thread_tick ();
+
+      /* Wake sleepers whose time has come.  The list is sorted,
+         so we stop at the first thread that must keep sleeping. */
+      while (!list_empty (&sleep_list))
+        {
+          struct thread *t = list_entry (list_front (&sleep_list),
+                                         struct thread, elem);
+          if (t->wakeup_tick > ticks)
+            break;
+          list_pop_front (&sleep_list);
+          thread_unblock (t);
+        }
+
+      /* Likewise, fire expired timeouts. */
+      while (!list_empty (&timeout_list))
+        {
+          struct timeout *to = list_entry (list_front (&timeout_list),
+                                           struct timeout, elem);
+          if (to->deadline > ticks)
+            break;
+          list_pop_front (&timeout_list);
+          to->armed = false;
+          to->func (to->aux);
+        }
+    }
+}
+
+/* Returns true if sleeping thread A wakes up before sleeping
+   thread B.  Threads with equal wakeup ticks keep their order of
+   arrival. */
+static bool
+wakeup_less (const struct list_elem *a_, const struct list_elem *b_,
+             void *aux UNUSED)
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+
+  return a->wakeup_tick < b->wakeup_tick;
+}
+
+/* Returns true if timeout A expires before timeout B.  Timeouts
+   with equal deadlines keep their order of arrival. */
+static bool
+deadline_less (const struct list_elem *a_, const struct list_elem *b_,
+               void *aux UNUSED)
+{
+  const struct timeout *a = list_entry (a_, struct timeout, elem);
+  const struct timeout *b = list_entry (b_, struct timeout, elem);
+
+  return a->deadline < b->deadline;
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
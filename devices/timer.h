@@ -1,7 +1,9 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <list.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
@@ -19,11 +21,33 @@ void timer_msleep (int64_t milliseconds);
 void timer_usleep (int64_t microseconds);
 void timer_nsleep (int64_t nanoseconds);
 
+/* Timeouts.  A timeout calls a function from the timer
+   interrupt handler once a given tick is reached, unless it is
+   cancelled first.  The caller owns the struct timeout, so
+   arming one never allocates memory. */
+typedef void timeout_func (void *aux);
+struct timeout
+  {
+    struct list_elem elem;      /* Element in list of armed timeouts. */
+    int64_t deadline;           /* Tick at which to call FUNC. */
+    timeout_func *func;         /* Called in interrupt context. */
+    void *aux;                  /* Argument to FUNC. */
+    bool armed;                 /* In the list of armed timeouts? */
+  };
+void timer_timeout_add (struct timeout *, int64_t deadline,
+                        timeout_func *, void *aux);
+void timer_timeout_cancel (struct timeout *);
+
 /* Busy waits. */
 void timer_mdelay (int64_t milliseconds);
 void timer_udelay (int64_t microseconds);
 void timer_ndelay (int64_t nanoseconds);
 
+/* Tickless idle. */
+extern bool timer_tickless;
+void timer_idle_enter (void);
+void timer_idle_exit (void);
+
 void timer_print_stats (void);
 
 #endif /* devices/timer.h */
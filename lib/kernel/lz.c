@@ -0,0 +1,213 @@
+#include "lz.h"
+#include <debug.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* Compressed data is a series of sequences, each of which is:
+
+     - A token byte.  Its high 4 bits are the number of literals
+       and its low 4 bits the match length minus LZ_MIN_MATCH.
+       A field of 15 is followed by extension bytes, each added
+       to it, up to and including the first byte other than 255.
+
+     - That many literal bytes, copied to the output as is.
+
+     - Unless this is the last sequence, a 2-byte little-endian
+       offset, followed by the match length's extension bytes.
+       The match copies that many bytes from OFFSET bytes back in
+       the output, which may overlap the bytes being written.
+
+   The last sequence ends at the end of the input, which is how
+   it is told apart from the others. */
+
+/* Shortest match worth encoding. */
+#define LZ_MIN_MATCH 4
+
+/* Hash table size, in bits, for finding matches. */
+#define LZ_HASH_BITS 10
+
+/* Largest value a token field holds without extension bytes. */
+#define LZ_FIELD_MAX 15
+
+/* Returns the 4 bytes at P as a word. */
+static inline uint32_t
+read32 (const uint8_t *p)
+{
+  uint32_t v;
+  memcpy (&v, p, sizeof v);
+  return v;
+}
+
+/* Returns the hash table index for the 4-byte sequence V. */
+static inline unsigned
+hash_seq (uint32_t v)
+{
+  return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Appends the extension bytes for token field value N to OP,
+   which must not pass OEND.  Returns the new end of output, or a
+   null pointer if it does not fit. */
+static uint8_t *
+put_length (uint8_t *op, uint8_t *oend, size_t n)
+{
+  if (n < LZ_FIELD_MAX)
+    return op;
+  for (n -= LZ_FIELD_MAX; ; n -= 255)
+    {
+      if (op >= oend)
+        return NULL;
+      *op++ = n < 255 ? n : 255;
+      if (n < 255)
+        return op;
+    }
+}
+
+/* Appends a sequence to OP, which must not pass OEND: LIT_CNT
+   literals from LIT followed, if MATCH_LEN is nonzero, by a
+   match of MATCH_LEN bytes OFFSET bytes back.  Returns the new
+   end of output, or a null pointer if it does not fit. */
+static uint8_t *
+put_sequence (uint8_t *op, uint8_t *oend, const uint8_t *lit, size_t lit_cnt,
+              size_t offset, size_t match_len)
+{
+  size_t ml = match_len > 0 ? match_len - LZ_MIN_MATCH : 0;
+
+  if (op >= oend)
+    return NULL;
+  *op++ = ((lit_cnt < LZ_FIELD_MAX ? lit_cnt : LZ_FIELD_MAX) << 4
+           | (ml < LZ_FIELD_MAX ? ml : LZ_FIELD_MAX));
+  op = put_length (op, oend, lit_cnt);
+  if (op == NULL || (size_t) (oend - op) < lit_cnt)
+    return NULL;
+  memcpy (op, lit, lit_cnt);
+  op += lit_cnt;
+
+  if (match_len > 0)
+    {
+      if (oend - op < 2)
+        return NULL;
+      *op++ = offset;
+      *op++ = offset >> 8;
+      op = put_length (op, oend, ml);
+    }
+  return op;
+}
+
+/* Compresses the SRC_SIZE bytes at SRC into DST, which has room
+   for DST_SIZE bytes, using the LZ_WORK_SIZE bytes at WORK as
+   scratch space.  Returns the compressed size, or 0 if it would
+   not fit in DST_SIZE bytes. */
+size_t
+lz_compress (const void *src_, size_t src_size,
+             void *dst_, size_t dst_size, void *work)
+{
+  const uint8_t *src = src_;
+  const uint8_t *end = src + src_size;
+  const uint8_t *ip = src;
+  const uint8_t *anchor = src;
+  uint8_t *dst = dst_;
+  uint8_t *op = dst;
+  uint8_t *oend = dst + dst_size;
+  uint16_t *table = work;
+
+  ASSERT (src_size <= LZ_MAX_INPUT);
+
+  memset (table, 0, LZ_WORK_SIZE);
+  while (end - ip >= LZ_MIN_MATCH)
+    {
+      uint32_t seq = read32 (ip);
+      unsigned h = hash_seq (seq);
+      const uint8_t *ref = src + table[h];
+      const uint8_t *m, *r;
+
+      table[h] = ip - src;
+      if (ref >= ip || read32 (ref) != seq)
+        {
+          ip++;
+          continue;
+        }
+
+      for (m = ip + LZ_MIN_MATCH, r = ref + LZ_MIN_MATCH;
+           m < end && *m == *r; m++, r++)
+        continue;
+      op = put_sequence (op, oend, anchor, ip - anchor, ip - ref, m - ip);
+      if (op == NULL)
+        return 0;
+      ip = anchor = m;
+    }
+
+  op = put_sequence (op, oend, anchor, end - anchor, 0, 0);
+  return op != NULL ? (size_t) (op - dst) : 0;
+}
+
+/* Reads the extension bytes of a token field from *IP, which
+   must not pass IEND, and adds them to *N.  Returns false if the
+   input ends first. */
+static bool
+get_length (const uint8_t **ip, const uint8_t *iend, size_t *n)
+{
+  uint8_t b;
+
+  if (*n < LZ_FIELD_MAX)
+    return true;
+  do
+    {
+      if (*ip >= iend)
+        return false;
+      b = *(*ip)++;
+      *n += b;
+    }
+  while (b == 255);
+  return true;
+}
+
+/* Decompresses the SRC_SIZE bytes at SRC, produced by
+   lz_compress(), into DST, which has room for DST_SIZE bytes.
+   Returns the decompressed size, or 0 if the input is corrupt or
+   does not fit. */
+size_t
+lz_decompress (const void *src, size_t src_size, void *dst_, size_t dst_size)
+{
+  const uint8_t *ip = src;
+  const uint8_t *iend = ip + src_size;
+  uint8_t *dst = dst_;
+  uint8_t *op = dst;
+  uint8_t *oend = dst + dst_size;
+
+  while (ip < iend)
+    {
+      uint8_t token = *ip++;
+      size_t lit_cnt = token >> 4;
+      size_t match_len = token & LZ_FIELD_MAX;
+      size_t offset;
+      const uint8_t *ref;
+
+      if (!get_length (&ip, iend, &lit_cnt)
+          || (size_t) (iend - ip) < lit_cnt
+          || (size_t) (oend - op) < lit_cnt)
+        return 0;
+      memcpy (op, ip, lit_cnt);
+      op += lit_cnt;
+      ip += lit_cnt;
+      if (ip == iend)
+        break;
+
+      if (iend - ip < 2)
+        return 0;
+      offset = ip[0] | (ip[1] << 8);
+      ip += 2;
+      if (!get_length (&ip, iend, &match_len))
+        return 0;
+      match_len += LZ_MIN_MATCH;
+      if (offset == 0 || offset > (size_t) (op - dst)
+          || (size_t) (oend - op) < match_len)
+        return 0;
+
+      /* Byte by byte, since the match may overlap its own
+         output. */
+      for (ref = op - offset; match_len > 0; match_len--)
+        *op++ = *ref++;
+    }
+  return op - dst;
+}
@@ -0,0 +1,24 @@
+#ifndef __LIB_KERNEL_LZ_H
+#define __LIB_KERNEL_LZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Fast LZ77 compression, in a byte-oriented format modeled on
+   LZ4's block format.  It favors speed over ratio: one hash
+   probe per input position, no entropy coding.  Inputs are
+   limited to LZ_MAX_INPUT bytes so that match offsets fit in 16
+   bits. */
+
+/* Largest input lz_compress() accepts. */
+#define LZ_MAX_INPUT 65536
+
+/* Bytes of scratch memory lz_compress() needs. */
+#define LZ_WORK_SIZE (1024 * sizeof (uint16_t))
+
+size_t lz_compress (const void *src, size_t src_size,
+                    void *dst, size_t dst_size, void *work);
+size_t lz_decompress (const void *src, size_t src_size,
+                      void *dst, size_t dst_size);
+
+#endif /* lib/kernel/lz.h */
@@ -0,0 +1,338 @@
+#include "rbtree.h"
+#include <debug.h>
+
+/* The algorithms follow Cormen, Leiserson, Rivest and Stein,
+   "Introduction to Algorithms", chapter 13, with null pointers
+   standing in for the black sentinel leaves.  Because a null
+   leaf has no parent pointer, rb_remove() tracks the parent of
+   the node it is fixing up separately. */
+
+static void rotate_left (struct rb_tree *, struct rb_elem *);
+static void rotate_right (struct rb_tree *, struct rb_elem *);
+static void replace_child (struct rb_tree *, struct rb_elem *old,
+                           struct rb_elem *new);
+static void insert_fixup (struct rb_tree *, struct rb_elem *);
+static void remove_fixup (struct rb_tree *, struct rb_elem *,
+                          struct rb_elem *parent);
+static struct rb_elem *leftmost (struct rb_elem *);
+
+/* Returns true if E is a red node.  Null leaves are black. */
+static inline bool
+is_red (const struct rb_elem *e)
+{
+  return e != NULL && e->red;
+}
+
+/* Initializes T as an empty tree that orders its elements with
+   LESS, given auxiliary data AUX. */
+void
+rb_init (struct rb_tree *t, rb_less_func *less, void *aux)
+{
+  ASSERT (t != NULL);
+  ASSERT (less != NULL);
+
+  t->root = NULL;
+  t->min = NULL;
+  t->less = less;
+  t->aux = aux;
+}
+
+/* Inserts E into T, after any elements equal to it. */
+void
+rb_insert (struct rb_tree *t, struct rb_elem *e)
+{
+  struct rb_elem **link = &t->root;
+  struct rb_elem *parent = NULL;
+  bool is_min = true;
+
+  ASSERT (t != NULL);
+  ASSERT (e != NULL);
+
+  while (*link != NULL)
+    {
+      parent = *link;
+      if (t->less (e, parent, t->aux))
+        link = &parent->left;
+      else
+        {
+          link = &parent->right;
+          is_min = false;
+        }
+    }
+
+  e->parent = parent;
+  e->left = e->right = NULL;
+  e->red = true;
+  *link = e;
+  if (is_min)
+    t->min = e;
+
+  insert_fixup (t, e);
+}
+
+/* Removes E, which must be in T, from T. */
+void
+rb_remove (struct rb_tree *t, struct rb_elem *e)
+{
+  struct rb_elem *x, *x_parent;
+  bool removed_red;
+
+  ASSERT (t != NULL);
+  ASSERT (e != NULL);
+
+  if (t->min == e)
+    t->min = rb_next (e);
+
+  if (e->left == NULL || e->right == NULL)
+    {
+      /* E has at most one child, which takes its place. */
+      x = e->left != NULL ? e->left : e->right;
+      x_parent = e->parent;
+      removed_red = e->red;
+      replace_child (t, e, x);
+    }
+  else
+    {
+      /* E's successor Y, which has no left child, takes its
+         place, and Y's right child takes Y's. */
+      struct rb_elem *y = leftmost (e->right);
+
+      removed_red = y->red;
+      x = y->right;
+      if (y->parent == e)
+        x_parent = y;
+      else
+        {
+          x_parent = y->parent;
+          replace_child (t, y, x);
+          y->right = e->right;
+          y->right->parent = y;
+        }
+      replace_child (t, e, y);
+      y->left = e->left;
+      y->left->parent = y;
+      y->red = e->red;
+    }
+
+  if (!removed_red)
+    remove_fixup (t, x, x_parent);
+}
+
+/* Returns the least element of T, or a null pointer if T is
+   empty.  Runs in constant time. */
+struct rb_elem *
+rb_min (const struct rb_tree *t)
+{
+  ASSERT (t != NULL);
+
+  return t->min;
+}
+
+/* Returns the element that follows E in its tree, or a null
+   pointer if E is the greatest. */
+struct rb_elem *
+rb_next (const struct rb_elem *e)
+{
+  ASSERT (e != NULL);
+
+  if (e->right != NULL)
+    return leftmost (e->right);
+  while (e->parent != NULL && e == e->parent->right)
+    e = e->parent;
+  return e->parent;
+}
+
+/* Returns true if T is empty, false otherwise. */
+bool
+rb_empty (const struct rb_tree *t)
+{
+  ASSERT (t != NULL);
+
+  return t->root == NULL;
+}
+
+/* Rotates the subtree rooted at X to the left, so that X's right
+   child takes X's place. */
+static void
+rotate_left (struct rb_tree *t, struct rb_elem *x)
+{
+  struct rb_elem *y = x->right;
+
+  x->right = y->left;
+  if (y->left != NULL)
+    y->left->parent = x;
+  replace_child (t, x, y);
+  y->left = x;
+  x->parent = y;
+}
+
+/* Rotates the subtree rooted at X to the right, so that X's left
+   child takes X's place. */
+static void
+rotate_right (struct rb_tree *t, struct rb_elem *x)
+{
+  struct rb_elem *y = x->left;
+
+  x->left = y->right;
+  if (y->right != NULL)
+    y->right->parent = x;
+  replace_child (t, x, y);
+  y->right = x;
+  x->parent = y;
+}
+
+/* Makes NEW, which may be null, take OLD's place as a child of
+   OLD's parent, or as T's root. */
+static void
+replace_child (struct rb_tree *t, struct rb_elem *old, struct rb_elem *new)
+{
+  if (old->parent == NULL)
+    t->root = new;
+  else if (old == old->parent->left)
+    old->parent->left = new;
+  else
+    old->parent->right = new;
+  if (new != NULL)
+    new->parent = old->parent;
+}
+
+/* Restores the red-black properties after red node E was
+   inserted into T. */
+static void
+insert_fixup (struct rb_tree *t, struct rb_elem *e)
+{
+  struct rb_elem *parent;
+
+  while ((parent = e->parent) != NULL && parent->red)
+    {
+      /* A red node is never the root, so PARENT has a parent. */
+      struct rb_elem *grandparent = parent->parent;
+
+      if (parent == grandparent->left)
+        {
+          struct rb_elem *uncle = grandparent->right;
+
+          if (is_red (uncle))
+            {
+              parent->red = uncle->red = false;
+              grandparent->red = true;
+              e = grandparent;
+              continue;
+            }
+          if (e == parent->right)
+            {
+              rotate_left (t, parent);
+              e = parent;
+              parent = e->parent;
+            }
+          parent->red = false;
+          grandparent->red = true;
+          rotate_right (t, grandparent);
+        }
+      else
+        {
+          struct rb_elem *uncle = grandparent->left;
+
+          if (is_red (uncle))
+            {
+              parent->red = uncle->red = false;
+              grandparent->red = true;
+              e = grandparent;
+              continue;
+            }
+          if (e == parent->left)
+            {
+              rotate_right (t, parent);
+              e = parent;
+              parent = e->parent;
+            }
+          parent->red = false;
+          grandparent->red = true;
+          rotate_left (t, grandparent);
+        }
+    }
+  t->root->red = false;
+}
+
+/* Restores the red-black properties after a black node was
+   removed from T.  X, which may be null, is the node that took
+   its place, and PARENT is X's parent. */
+static void
+remove_fixup (struct rb_tree *t, struct rb_elem *x, struct rb_elem *parent)
+{
+  while (x != t->root && !is_red (x))
+    {
+      if (x == parent->left)
+        {
+          struct rb_elem *sibling = parent->right;
+
+          if (sibling->red)
+            {
+              sibling->red = false;
+              parent->red = true;
+              rotate_left (t, parent);
+              sibling = parent->right;
+            }
+          if (!is_red (sibling->left) && !is_red (sibling->right))
+            {
+              sibling->red = true;
+              x = parent;
+              parent = x->parent;
+              continue;
+            }
+          if (!is_red (sibling->right))
+            {
+              sibling->left->red = false;
+              sibling->red = true;
+              rotate_right (t, sibling);
+              sibling = parent->right;
+            }
+          sibling->red = parent->red;
+          parent->red = false;
+          sibling->right->red = false;
+          rotate_left (t, parent);
+        }
+      else
+        {
+          struct rb_elem *sibling = parent->left;
+
+          if (sibling->red)
+            {
+              sibling->red = false;
+              parent->red = true;
+              rotate_right (t, parent);
+              sibling = parent->left;
+            }
+          if (!is_red (sibling->left) && !is_red (sibling->right))
+            {
+              sibling->red = true;
+              x = parent;
+              parent = x->parent;
+              continue;
+            }
+          if (!is_red (sibling->left))
+            {
+              sibling->right->red = false;
+              sibling->red = true;
+              rotate_left (t, sibling);
+              sibling = parent->left;
+            }
+          sibling->red = parent->red;
+          parent->red = false;
+          sibling->left->red = false;
+          rotate_right (t, parent);
+        }
+      x = t->root;
+    }
+  if (x != NULL)
+    x->red = false;
+}
+
+/* Returns the least element of the subtree rooted at E. */
+static struct rb_elem *
+leftmost (struct rb_elem *e)
+{
+  while (e->left != NULL)
+    e = e->left;
+  return e;
+}
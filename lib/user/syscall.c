@@ -182,3 +182,15 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+int
+futex_wait (int *addr, int expected)
+{
+  return syscall2 (SYS_FUTEX_WAIT, addr, expected);
+}
+
+int
+futex_wake (int *addr, int n)
+{
+  return syscall2 (SYS_FUTEX_WAKE, addr, n);
+}
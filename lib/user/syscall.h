@@ -45,4 +45,8 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+int futex_wait (int *addr, int expected);
+int futex_wake (int *addr, int n);
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,38 @@
+/* Runs a child process, an instance of the same executable, that
+   blocks in futex_wait() on a word in a read-only page.  That
+   page is shared by every process running the executable, so the
+   parent's futex_wake() on the same word must wake the child. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+/* The futex word, kept in a read-only page. */
+static const int word = 0;
+
+int
+main (int argc, char *argv[])
+{
+  pid_t child;
+  int woken;
+
+  if (argc == 2 && !strcmp (argv[1], "child"))
+    {
+      /* Blocks until the parent wakes us. */
+      test_name = "child-futex";
+      return futex_wait ((int *) &word, 0) == 0 ? 0 : 1;
+    }
+
+  test_name = "futex-wake";
+  msg ("begin");
+  CHECK ((child = exec ("futex-wake child")) != -1,
+         "exec \"futex-wake child\"");
+
+  /* Keep waking until the child has gone to sleep and is woken. */
+  while ((woken = futex_wake ((int *) &word, 1)) == 0)
+    continue;
+  CHECK (woken == 1, "futex_wake woke the child");
+  CHECK (wait (child) == 0, "wait for child");
+  msg ("end");
+  return 0;
+}
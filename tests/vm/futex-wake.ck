@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(futex-wake) begin
+(futex-wake) exec "futex-wake child"
+(futex-wake) futex_wake woke the child
+(futex-wake) wait for child
+(futex-wake) end
+EOF
+pass;
@@ -0,0 +1,63 @@
+#ifndef THREADS_FIXED_POINT_H
+#define THREADS_FIXED_POINT_H
+
+#include <stdint.h>
+
+/* Signed 17.14 fixed-point numbers, as used by the 4.4BSD
+   scheduler: the low 14 bits of an int hold the fraction, the
+   next 17 bits the integer part, and the top bit the sign.
+
+   Products and quotients of two fixed-point numbers are
+   computed in 64 bits so that the intermediate result does not
+   overflow. */
+typedef int fixed_point;
+
+/* Number of fraction bits. */
+#define FP_SHIFT 14
+
+/* The fixed-point number 1. */
+#define FP_ONE (1 << FP_SHIFT)
+
+/* Converts integer N to fixed point. */
+static inline fixed_point
+fp_from_int (int n)
+{
+  return n * FP_ONE;
+}
+
+/* Converts X to an integer, rounding toward zero. */
+static inline int
+fp_trunc (fixed_point x)
+{
+  return x / FP_ONE;
+}
+
+/* Converts X to an integer, rounding to nearest. */
+static inline int
+fp_round (fixed_point x)
+{
+  return x >= 0 ? (x + FP_ONE / 2) / FP_ONE : (x - FP_ONE / 2) / FP_ONE;
+}
+
+/* Returns X + N, where N is an integer. */
+static inline fixed_point
+fp_add_int (fixed_point x, int n)
+{
+  return x + n * FP_ONE;
+}
+
+/* Returns X * Y. */
+static inline fixed_point
+fp_mul (fixed_point x, fixed_point y)
+{
+  return ((int64_t) x) * y / FP_ONE;
+}
+
+/* Returns X / Y. */
+static inline fixed_point
+fp_div (fixed_point x, fixed_point y)
+{
+  return ((int64_t) x) * FP_ONE / y;
+}
+
+#endif /* threads/fixed-point.h */
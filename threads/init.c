@@ -20,9 +20,13 @@
 #include "threads/loader.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/profile.h"
 #include "threads/pte.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/workqueue.h"
 #include "vm/frame.h"
+#include "vm/share.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
@@ -99,6 +103,8 @@ main (void)
   palloc_init (user_page_limit);
   malloc_init ();
   paging_init ();
+  profile_init ();
+  trace_init ();
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -114,10 +120,12 @@ main (void)
 #ifdef USERPROG
   exception_init ();
   syscall_init ();
+  process_init ();
 #endif
 
   /* Start thread scheduler and enable interrupts. */
   thread_start ();
+  workqueue_init ();
   serial_init_queue ();
   timer_calibrate ();
 
@@ -129,6 +137,7 @@ main (void)
   filesys_init (format_filesys);
 #endif
   frame_init();
+  share_init ();
   swap_init ();
 
   printf ("Boot complete.\n");
@@ -255,11 +264,21 @@ parse_options (char **argv)
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
 #endif
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-wsclock"))
+        frame_wsclock = true;
 #endif
       else if (!strcmp (name, "-rs"))
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-cfs"))
+        thread_cfs = true;
+      else if (!strcmp (name, "-tickless"))
+        timer_tickless = true;
+      else if (!strcmp (name, "-profile"))
+        profile_enabled = true;
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
@@ -267,6 +286,8 @@ parse_options (char **argv)
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
     }
+  if (thread_mlfqs && thread_cfs)
+    PANIC ("-mlfqs and -cfs cannot be used together");
 
   /* Initialize the random number generator based on the system
      time.  This has no effect if an "-rs" option was specified.
@@ -281,6 +302,15 @@ parse_options (char **argv)
   return argv;
 }
 
+#if TRACE_EVENTS
+/* Prints the trace ring buffer. */
+static void
+trace_dump_action (char **argv UNUSED)
+{
+  trace_dump ();
+}
+#endif
+
 /* Runs the task specified in ARGV[1]. */
 static void
 run_task (char **argv)
@@ -313,6 +343,9 @@ run_actions (char **argv)
   static const struct action actions[] =
     {
       {"run", 2, run_task},
+#if TRACE_EVENTS
+      {"trace-dump", 1, trace_dump_action},
+#endif
 #ifdef FILESYS
       {"ls", 1, fsutil_ls},
       {"cat", 2, fsutil_cat},
@@ -368,6 +401,9 @@ usage (void)
           "Use these actions indirectly via `pintos' -g and -p options:\n"
           "  extract            Untar from scratch device into file system.\n"
           "  append FILE        Append FILE to tar file on scratch device.\n"
+#endif
+#if TRACE_EVENTS
+          "  trace-dump         Print the trace buffer.\n"
 #endif
           "\nOptions:\n"
           "  -h                 Print this help message and power off.\n"
@@ -383,6 +419,12 @@ usage (void)
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -cfs               Use completely fair scheduler.\n"
+          "  -tickless          Stop the timer tick while idle.\n"
+          "  -profile           Sample the running code at each tick.\n"
+#ifdef VM
+          "  -wsclock           Evict pages with WSClock instead of clock.\n"
+#endif
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
 #endif
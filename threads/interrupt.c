@@ -47,6 +47,40 @@ static unsigned int unexpected_cnt[INTR_CNT];
 static bool in_external_intr;   /* Are we processing an external interrupt? */
 static bool yield_on_return;    /* Should we yield on interrupt return? */
 
+#if IRQSOFF_TRACE
+/* Interrupts-off latency tracer.
+
+   Every transition of the interrupt flag from on to off, through
+   intr_disable() or intr_set_level() or by the CPU delivering an
+   interrupt, starts an interval timestamped with the TSC, and
+   the next transition back to on ends it.  The IRQSOFF_WORST
+   longest intervals are kept with the code addresses at both
+   ends. */
+#define IRQSOFF_WORST 8
+
+struct irqsoff_interval
+  {
+    uint64_t cycles;            /* Length in TSC cycles. */
+    void *off_pc;               /* Where interrupts were turned off. */
+    void *on_pc;                /* Where they were turned back on. */
+  };
+
+/* Longest intervals so far, longest first. */
+static struct irqsoff_interval irqsoff_worst[IRQSOFF_WORST];
+
+/* Current interval: TSC and address at which interrupts went
+   off.  IRQSOFF_START is 0 while interrupts are on. */
+static uint64_t irqsoff_start;
+static void *irqsoff_pc;
+
+/* TSC at intr_init(), for converting cycles to time. */
+static uint64_t boot_tsc;
+
+static inline uint64_t rdtsc (void);
+static void irqsoff_begin (void *pc);
+static void irqsoff_end (void *pc);
+#endif
+
 /* Programmable Interrupt Controller helpers. */
 static void pic_init (void);
 static void pic_end_of_interrupt (int irq);
@@ -75,21 +109,19 @@ intr_get_level (void)
   return flags & FLAG_IF ? INTR_ON : INTR_OFF;
 }
 
-/* Enables or disables interrupts as specified by LEVEL and
-   returns the previous interrupt status. */
-enum intr_level
-intr_set_level (enum intr_level level)
-{
-  return level == INTR_ON ? intr_enable () : intr_disable ();
-}
-
-/* Enables interrupts and returns the previous interrupt status. */
-enum intr_level
-intr_enable (void)
+/* Enables interrupts, called from PC, and returns the previous
+   interrupt status. */
+static inline enum intr_level
+enable (void *pc UNUSED)
 {
   enum intr_level old_level = intr_get_level ();
   ASSERT (!intr_context ());
 
+#if IRQSOFF_TRACE
+  if (old_level == INTR_OFF)
+    irqsoff_end (pc);
+#endif
+
   /* Enable interrupts by setting the interrupt flag.
 
      See [IA32-v2b] "STI" and [IA32-v3a] 5.8.1 "Masking Maskable
@@ -99,9 +131,10 @@ intr_enable (void)
   return old_level;
 }
 
-/* Disables interrupts and returns the previous interrupt status. */
-enum intr_level
-intr_disable (void)
+/* Disables interrupts, called from PC, and returns the previous
+   interrupt status. */
+static inline enum intr_level
+disable (void *pc UNUSED)
 {
   enum intr_level old_level = intr_get_level ();
 
@@ -110,8 +143,36 @@ intr_disable (void)
      Hardware Interrupts". */
   asm volatile ("cli" : : : "memory");
 
+#if IRQSOFF_TRACE
+  if (old_level == INTR_ON)
+    irqsoff_begin (pc);
+#endif
+
   return old_level;
 }
+
+/* Enables or disables interrupts as specified by LEVEL and
+   returns the previous interrupt status. */
+enum intr_level
+intr_set_level (enum intr_level level)
+{
+  void *pc = __builtin_return_address (0);
+  return level == INTR_ON ? enable (pc) : disable (pc);
+}
+
+/* Enables interrupts and returns the previous interrupt status. */
+enum intr_level
+intr_enable (void)
+{
+  return enable (__builtin_return_address (0));
+}
+
+/* Disables interrupts and returns the previous interrupt status. */
+enum intr_level
+intr_disable (void)
+{
+  return disable (__builtin_return_address (0));
+}
 
 /* Initializes the interrupt system. */
 void
@@ -120,6 +181,10 @@ intr_init (void)
   uint64_t idtr_operand;
   int i;
 
+#if IRQSOFF_TRACE
+  boot_tsc = rdtsc ();
+#endif
+
   /* Initialize interrupt controller. */
   pic_init ();
 
@@ -347,6 +412,15 @@ intr_handler (struct intr_frame *frame)
   bool external;
   intr_handler_func *handler;
 
+#if IRQSOFF_TRACE
+  /* If the CPU turned interrupts off to deliver this interrupt,
+     they stay off until it returns. */
+  bool traced = (frame->eflags & FLAG_IF) != 0
+                && intr_get_level () == INTR_OFF;
+  if (traced)
+    irqsoff_begin (frame->eip);
+#endif
+
   /* External interrupts are special.
      We only handle one at a time (so interrupts must be off)
      and they need to be acknowledged on the PIC (see below).
@@ -386,6 +460,11 @@ intr_handler (struct intr_frame *frame)
       if (yield_on_return)
         thread_yield ();
     }
+
+#if IRQSOFF_TRACE
+  if (traced)
+    irqsoff_end (intr_handlers[frame->vec_no]);
+#endif
 }
 
 /* Handles an unexpected interrupt with interrupt frame F.  An
@@ -436,3 +515,84 @@ intr_name (uint8_t vec)
 {
   return intr_names[vec];
 }
+
+#if IRQSOFF_TRACE
+/* Tells the tracer that the caller, which must be the idle
+   thread, is about to turn interrupts on without intr_enable(),
+   with its atomic `sti; hlt'. */
+void
+intr_trace_sti (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  irqsoff_end (__builtin_return_address (0));
+}
+
+/* Prints the longest intervals with interrupts off.  Each line
+   ends in the addresses where interrupts were turned off and
+   back on, in the same form as a backtrace, so that it can be
+   passed to the backtrace utility. */
+void
+intr_print_stats (void)
+{
+  int64_t ticks = timer_ticks ();
+  uint64_t cycles_per_tick = 0;
+  int i;
+
+  if (ticks > 0)
+    cycles_per_tick = (rdtsc () - boot_tsc) / ticks;
+
+  printf ("Interrupts off: longest intervals\n");
+  for (i = 0; i < IRQSOFF_WORST && irqsoff_worst[i].cycles != 0; i++)
+    {
+      const struct irqsoff_interval *iv = &irqsoff_worst[i];
+      uint64_t us = (cycles_per_tick > 0
+                     ? iv->cycles * (1000000 / TIMER_FREQ) / cycles_per_tick
+                     : 0);
+
+      printf ("  %"PRIu64" cycles (%"PRIu64" us): Call stack: %p %p.\n",
+              iv->cycles, us, iv->off_pc, iv->on_pc);
+    }
+}
+
+/* Returns the CPU's time-stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Starts an interval with interrupts off at PC.  Interrupts must
+   be off. */
+static void
+irqsoff_begin (void *pc)
+{
+  irqsoff_start = rdtsc ();
+  irqsoff_pc = pc;
+}
+
+/* Ends the current interval with interrupts off at PC, if there
+   is one, and records it if it is among the longest.  Interrupts
+   must be off. */
+static void
+irqsoff_end (void *pc)
+{
+  uint64_t cycles;
+  int i;
+
+  if (irqsoff_start == 0)
+    return;
+  cycles = rdtsc () - irqsoff_start;
+  irqsoff_start = 0;
+
+  if (cycles <= irqsoff_worst[IRQSOFF_WORST - 1].cycles)
+    return;
+  for (i = IRQSOFF_WORST - 1; i > 0 && irqsoff_worst[i - 1].cycles < cycles;
+       i--)
+    irqsoff_worst[i] = irqsoff_worst[i - 1];
+  irqsoff_worst[i].cycles = cycles;
+  irqsoff_worst[i].off_pc = irqsoff_pc;
+  irqsoff_worst[i].on_pc = pc;
+}
+#endif /* IRQSOFF_TRACE */
@@ -67,4 +67,19 @@ void intr_yield_on_return (void);
 void intr_dump_frame (const struct intr_frame *);
 const char *intr_name (uint8_t vec);
 
+/* Set to 1 to trace how long interrupts stay disabled.  The
+   longest intervals are reported at shutdown.  At 0 the tracer
+   is compiled out entirely. */
+#ifndef IRQSOFF_TRACE
+#define IRQSOFF_TRACE 0
+#endif
+
+#if IRQSOFF_TRACE
+void intr_trace_sti (void);
+void intr_print_stats (void);
+#else
+#define intr_trace_sti() ((void) 0)
+#define intr_print_stats() ((void) 0)
+#endif
+
 #endif /* threads/interrupt.h */
@@ -41,6 +41,9 @@ struct desc
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
     struct list free_list;      /* List of free blocks. */
     struct lock lock;           /* Lock. */
+#if LOCK_STATS
+    char name[16];              /* Lock name, e.g. "malloc 16". */
+#endif
   };
 
 /* Magic number for detecting arena corruption. */
@@ -81,6 +84,10 @@ malloc_init (void)
       d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
       list_init (&d->free_list);
       lock_init (&d->lock);
+#if LOCK_STATS
+      snprintf (d->name, sizeof d->name, "malloc %zu", block_size);
+      lock_set_name (&d->lock, d->name);
+#endif
     }
 }
 
@@ -0,0 +1,125 @@
+#include "threads/profile.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Sampling profiler.
+
+   At each timer tick, profile_sample() stores the interrupted
+   instruction pointer and, for kernel code, up to
+   PROFILE_DEPTH - 1 return addresses found by following saved
+   frame pointers.  Samples go into a buffer allocated once at
+   boot; when it fills up, further samples are only counted.
+   profile_dump() prints the samples at shutdown, one per line,
+   for utils/pintos-profile to turn into a flat profile or folded
+   stacks. */
+
+bool profile_enabled;
+
+/* Addresses per sample, including the sampled PC. */
+#define PROFILE_DEPTH 8
+
+/* Pages in the sample buffer. */
+#define PROFILE_PAGES 32
+
+/* One sample: the interrupted PC first, then its callers.
+   Unused slots are 0. */
+struct sample
+  {
+    uint32_t pc[PROFILE_DEPTH];
+  };
+
+static struct sample *samples;  /* Sample buffer. */
+static size_t sample_max;       /* Capacity of SAMPLES. */
+static size_t sample_cnt;       /* Samples stored. */
+static unsigned long long dropped_cnt; /* Samples lost to a full buffer. */
+
+/* Allocates the sample buffer, if profiling is enabled.  Must be
+   called after the page allocator is initialized. */
+void
+profile_init (void)
+{
+  if (!profile_enabled)
+    return;
+
+  samples = palloc_get_multiple (0, PROFILE_PAGES);
+  if (samples == NULL)
+    {
+      printf ("profile: cannot allocate sample buffer, profiling disabled\n");
+      profile_enabled = false;
+      return;
+    }
+  sample_max = PROFILE_PAGES * PGSIZE / sizeof *samples;
+}
+
+/* Records a sample of the code interrupted with frame F.  Called
+   from the timer interrupt handler. */
+void
+profile_sample (const struct intr_frame *f)
+{
+  struct sample *s;
+  int depth;
+
+  ASSERT (intr_context ());
+
+  if (sample_cnt >= sample_max)
+    {
+      dropped_cnt++;
+      return;
+    }
+
+  s = &samples[sample_cnt++];
+  s->pc[0] = (uint32_t) f->eip;
+  depth = 1;
+
+  /* Follow the frame pointer chain, but only within the kernel
+     stack we are running on, which is the interrupted thread's,
+     so that a corrupt or user frame pointer is never
+     dereferenced.  Each frame holds the caller's frame pointer
+     followed by the return address. */
+  if (f->cs == SEL_KCSEG)
+    {
+      uint32_t *fp = f->frame_pointer;
+      void *stack_page = pg_round_down (&depth);
+
+      while (depth < PROFILE_DEPTH
+             && pg_round_down (fp) == stack_page
+             && pg_ofs (fp) <= PGSIZE - 2 * sizeof *fp
+             && fp[1] != 0)
+        {
+          s->pc[depth++] = fp[1];
+          fp = (uint32_t *) fp[0];
+        }
+    }
+  while (depth < PROFILE_DEPTH)
+    s->pc[depth++] = 0;
+}
+
+/* Prints all samples, if profiling is enabled.  Each sample is a
+   line starting with "PS:" and giving the sampled PC and then
+   its callers, innermost first. */
+void
+profile_dump (void)
+{
+  size_t i;
+
+  if (!profile_enabled)
+    return;
+
+  printf ("Profile: %zu samples, %llu dropped\n", sample_cnt, dropped_cnt);
+  for (i = 0; i < sample_cnt; i++)
+    {
+      const struct sample *s = &samples[i];
+      int j;
+
+      printf ("PS:");
+      for (j = 0; j < PROFILE_DEPTH && s->pc[j] != 0; j++)
+        printf (" %#"PRIx32, s->pc[j]);
+      printf ("\n");
+    }
+}
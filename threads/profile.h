@@ -0,0 +1,18 @@
+#ifndef THREADS_PROFILE_H
+#define THREADS_PROFILE_H
+
+#include <stdbool.h>
+
+struct intr_frame;
+
+/* Sampling profiler.  If true, the timer interrupt records the
+   interrupted program counter and a short kernel call chain at
+   every tick.  Controlled by kernel command-line option
+   "-profile". */
+extern bool profile_enabled;
+
+void profile_init (void);
+void profile_sample (const struct intr_frame *);
+void profile_dump (void);
+
+#endif /* threads/profile.h */
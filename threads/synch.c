@@ -29,9 +29,34 @@
 #include "threads/synch.h"
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 
+/* Maximum length of a chain of lock holders that a priority
+   donation is passed along. */
+#define DONATION_DEPTH_MAX 8
+
+static void donate_priority (struct thread *);
+static void withdraw_donation (struct lock *);
+static bool sema_down_until (struct semaphore *, int64_t deadline);
+static timeout_func sema_timeout;
+static bool lock_acquire_until (struct lock *, int64_t deadline);
+
+/* Deadline for waits that never time out. */
+#define NO_DEADLINE INT64_MAX
+
+#if LOCK_STATS
+/* Locks given a name with lock_set_name() or rwlock_set_name(),
+   in order of naming. */
+static struct list named_locks = LIST_INITIALIZER (named_locks);
+
+static void stats_init (struct lock_stats *);
+static void stats_acquired (struct lock_stats *, bool contended,
+                            int64_t wait_start);
+static void stats_released (struct lock_stats *);
+#endif
+
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
    manipulating it:
@@ -60,19 +85,81 @@ sema_init (struct semaphore *sema, unsigned value)
 void
 sema_down (struct semaphore *sema)
 {
-  enum intr_level old_level;
+  ASSERT (sema != NULL);
+  ASSERT (!intr_context ());
 
+  sema_down_until (sema, NO_DEADLINE);
+}
+
+/* Down or "P" operation on a semaphore, like sema_down(), but
+   gives up after TICKS timer ticks.  Returns true if SEMA was
+   downed, false if the time ran out first.  With TICKS <= 0,
+   behaves like sema_try_down().
+
+   The waiting thread blocks, and a timer timeout wakes it up if
+   the semaphore is not upped in time, so the wait costs no CPU
+   time.  This function may sleep, so it must not be called
+   within an interrupt handler. */
+bool
+sema_down_timeout (struct semaphore *sema, int64_t ticks)
+{
   ASSERT (sema != NULL);
   ASSERT (!intr_context ());
 
+  return sema_down_until (sema, timer_ticks () + ticks);
+}
+
+/* Downs SEMA, waiting until it is positive or until timer tick
+   DEADLINE, whichever comes first.  Returns true if SEMA was
+   downed. */
+static bool
+sema_down_until (struct semaphore *sema, int64_t deadline)
+{
+  enum intr_level old_level;
+  bool success = true;
+
   old_level = intr_disable ();
   while (sema->value == 0)
     {
-      list_push_back (&sema->waiters, &thread_current ()->elem);
+      struct thread *cur = thread_current ();
+      struct timeout timeout;
+
+      if (deadline != NO_DEADLINE && timer_ticks () >= deadline)
+        {
+          success = false;
+          break;
+        }
+
+      list_insert_ordered (&sema->waiters, &cur->elem,
+                           thread_priority_greater, NULL);
+      cur->wait_queue = &sema->waiters;
+      if (deadline != NO_DEADLINE)
+        timer_timeout_add (&timeout, deadline, sema_timeout, cur);
       thread_block ();
+      if (deadline != NO_DEADLINE)
+        timer_timeout_cancel (&timeout);
     }
-  sema->value--;
+  if (success)
+    sema->value--;
   intr_set_level (old_level);
+
+  return success;
+}
+
+/* Timeout function for sema_down_until().  Takes thread T_ off
+   its semaphore's wait list and wakes it, unless sema_up()
+   already did. */
+static void
+sema_timeout (void *t_)
+{
+  struct thread *t = t_;
+
+  if (t->wait_queue != NULL)
+    {
+      list_remove (&t->elem);
+      t->wait_queue = NULL;
+      thread_unblock (t);
+    }
 }
 
 /* Down or "P" operation on a semaphore, but only if the
@@ -102,7 +189,9 @@ sema_try_down (struct semaphore *sema)
 }
 
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
-   and wakes up one thread of those waiting for SEMA, if any.
+   and wakes up the highest-priority thread of those waiting for
+   SEMA, if any.  If the woken thread has a higher priority than the running
+   thread, the running thread yields to it.
 
    This function may be called from an interrupt handler. */
 void
@@ -114,10 +203,52 @@ sema_up (struct semaphore *sema)
 
   old_level = intr_disable ();
   if (!list_empty (&sema->waiters))
-    thread_unblock (list_entry (list_pop_front (&sema->waiters),
-                                struct thread, elem));
+    {
+      struct thread *t = list_entry (list_pop_front (&sema->waiters),
+                                     struct thread, elem);
+      t->wait_queue = NULL;
+      thread_unblock (t);
+    }
+  sema->value++;
+  intr_set_level (old_level);
+
+  /* thread_unblock() could not preempt us with interrupts off. */
+  if (old_level == INTR_ON)
+    thread_preempt ();
+}
+
+/* Like sema_up(), but for a caller that is about to block or
+   yield anyway, typically right after waking a thread waiting
+   for its reply or its exit.  If the woken thread's priority is
+   at least the caller's, the caller switches to it at once
+   through thread_handoff() instead of sending it through the run
+   queue.
+
+   Unlike sema_up(), this function must not be called from an
+   interrupt handler. */
+void
+sema_up_handoff (struct semaphore *sema)
+{
+  enum intr_level old_level;
+
+  ASSERT (sema != NULL);
+  ASSERT (!intr_context ());
+
+  old_level = intr_disable ();
   sema->value++;
+  if (!list_empty (&sema->waiters))
+    {
+      struct thread *t = list_entry (list_pop_front (&sema->waiters),
+                                     struct thread, elem);
+      t->wait_queue = NULL;
+      thread_handoff (t);
+    }
   intr_set_level (old_level);
+
+  /* If there was no handoff, a higher-priority thread may still
+     be ready. */
+  if (old_level == INTR_ON)
+    thread_preempt ();
 }
 
 static void sema_test_helper (void *sema_);
@@ -179,12 +310,21 @@ lock_init (struct lock *lock)
 
   lock->holder = NULL;
   sema_init (&lock->semaphore, 1);
+#if LOCK_STATS
+  stats_init (&lock->stats);
+#endif
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
    thread.
 
+   While we wait, our priority is donated to the lock's holder,
+   and on along the chain of locks that the holder is itself
+   waiting for, so that a lower-priority holder cannot keep us
+   waiting indefinitely.  Priority donation is not done under the
+   multi-level feedback queue scheduler.
+
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
@@ -196,8 +336,67 @@ lock_acquire (struct lock *lock)
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
-  sema_down (&lock->semaphore);
-  lock->holder = thread_current ();
+  lock_acquire_until (lock, NO_DEADLINE);
+}
+
+/* Acquires LOCK like lock_acquire(), but gives up after TICKS
+   timer ticks.  Returns true if LOCK was acquired, false if the
+   time ran out first.  While waiting, the current thread donates
+   its priority to the holder as usual; the donation is withdrawn
+   if the wait times out.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool
+lock_acquire_timeout (struct lock *lock, int64_t ticks)
+{
+  ASSERT (lock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!lock_held_by_current_thread (lock));
+
+  return lock_acquire_until (lock, timer_ticks () + ticks);
+}
+
+/* Acquires LOCK, waiting at most until timer tick DEADLINE.
+   Returns true if successful. */
+static bool
+lock_acquire_until (struct lock *lock, int64_t deadline)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+#if LOCK_STATS
+  bool contended = lock->holder != NULL;
+  int64_t wait_start = timer_ticks ();
+#endif
+  if (lock->holder != NULL && !thread_mlfqs)
+    {
+      cur->wait_lock = lock;
+      donate_priority (cur);
+    }
+  if (!sema_down_until (&lock->semaphore, deadline))
+    {
+      /* Withdraw our donation. */
+      cur->wait_lock = NULL;
+      if (!thread_mlfqs)
+        withdraw_donation (lock);
+      intr_set_level (old_level);
+      return false;
+    }
+  cur->wait_lock = NULL;
+  lock->holder = cur;
+  list_push_back (&cur->held_locks, &lock->elem);
+#if LOCK_STATS
+  stats_acquired (&lock->stats, contended, wait_start);
+#endif
+
+  /* Threads still waiting for LOCK now donate to us. */
+  if (!thread_mlfqs)
+    thread_refresh_priority (cur);
+  intr_set_level (old_level);
+
+  return true;
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -209,18 +408,29 @@ lock_acquire (struct lock *lock)
 bool
 lock_try_acquire (struct lock *lock)
 {
+  enum intr_level old_level;
   bool success;
 
   ASSERT (lock != NULL);
   ASSERT (!lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    {
+      lock->holder = thread_current ();
+      list_push_back (&lock->holder->held_locks, &lock->elem);
+#if LOCK_STATS
+      stats_acquired (&lock->stats, false, timer_ticks ());
+#endif
+    }
+  intr_set_level (old_level);
   return success;
 }
 
 /* Releases LOCK, which must be owned by the current thread.
+   Drops the priority donated through LOCK, keeping any donations
+   that still arrive through other locks we hold.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
@@ -228,10 +438,21 @@ lock_try_acquire (struct lock *lock)
 void
 lock_release (struct lock *lock)
 {
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
+#if LOCK_STATS
+  stats_released (&lock->stats);
+#endif
   lock->holder = NULL;
+  list_remove (&lock->elem);
+  if (!thread_mlfqs)
+    thread_refresh_priority (thread_current ());
+  intr_set_level (old_level);
+
   sema_up (&lock->semaphore);
 }
 
@@ -246,13 +467,359 @@ lock_held_by_current_thread (const struct lock *lock)
   return lock->holder == thread_current ();
 }
 
+/* Donates T's priority to the holder of the lock T is waiting
+   for, then to the holder of the lock that holder is waiting for,
+   and so on, up to DONATION_DEPTH_MAX links.  Stops early at a
+   holder whose priority is already high enough.  Interrupts must
+   be off. */
+static void
+donate_priority (struct thread *t)
+{
+  struct lock *lock = t->wait_lock;
+  int depth;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (depth = 0; lock != NULL && depth < DONATION_DEPTH_MAX; depth++)
+    {
+      struct thread *holder = lock->holder;
+
+      if (holder == NULL || holder->priority >= t->priority)
+        break;
+      thread_donate_priority (holder, t->priority);
+      lock = holder->wait_lock;
+    }
+}
+
+/* Undoes donate_priority() for a thread that has stopped waiting
+   for LOCK: recomputes the priority of LOCK's holder, then of the
+   holder of the lock that holder is waiting for, and so on, up to
+   DONATION_DEPTH_MAX links.  Interrupts must be off. */
+static void
+withdraw_donation (struct lock *lock)
+{
+  int depth;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (depth = 0; lock != NULL && depth < DONATION_DEPTH_MAX; depth++)
+    {
+      struct thread *holder = lock->holder;
+
+      if (holder == NULL)
+        break;
+      thread_refresh_priority (holder);
+      lock = holder->wait_lock;
+    }
+}
+
+/* Initializes RWLOCK.  A reader-writer lock may be held by any
+   number of readers at once, or by a single writer.
+
+   Writers are preferred: a thread that wants to read waits while
+   a writer of equal or higher priority is waiting, so a stream
+   of readers cannot starve writers.  A reader with a higher
+   priority than every waiting writer still gets in, so that
+   priorities are respected.  When the lock is released, waiters
+   are woken in order of priority. */
+void
+rwlock_init (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  rw->readers = 0;
+  rw->writer = NULL;
+  list_init (&rw->read_waiters);
+  list_init (&rw->write_waiters);
+#if LOCK_STATS
+  stats_init (&rw->stats);
+#endif
+}
+
+/* Returns the highest-priority thread in WAITERS, a list of
+   threads linked through their `elem' members, or NULL if WAITERS
+   is empty. */
+static struct thread *
+max_priority_waiter (struct list *waiters)
+{
+  struct thread *max = NULL;
+  struct list_elem *e;
+
+  for (e = list_begin (waiters); e != list_end (waiters); e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct thread, elem);
+      if (max == NULL || t->priority > max->priority)
+        max = t;
+    }
+  return max;
+}
+
+/* Returns true if thread T, which wants to read RW, must wait.
+   Interrupts must be off. */
+static bool
+rwlock_reader_must_wait (struct rwlock *rw, struct thread *t)
+{
+  struct thread *w;
+
+  if (rw->writer != NULL)
+    return true;
+  w = max_priority_waiter (&rw->write_waiters);
+  return w != NULL && w->priority >= t->priority;
+}
+
+/* Wakes the threads that may take RW now that nobody holds it to
+   write: every waiting reader of higher priority than all waiting
+   writers, or else, if RW is free, the highest-priority waiting
+   writer.  Interrupts must be off. */
+static void
+rwlock_wake (struct rwlock *rw)
+{
+  struct thread *w = max_priority_waiter (&rw->write_waiters);
+  struct list_elem *e;
+  bool woke_reader = false;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (rw->writer == NULL);
+
+  for (e = list_begin (&rw->read_waiters); e != list_end (&rw->read_waiters);)
+    {
+      struct thread *t = list_entry (e, struct thread, elem);
+      e = list_next (e);
+      if (w == NULL || t->priority > w->priority)
+        {
+          list_remove (&t->elem);
+          thread_unblock (t);
+          woke_reader = true;
+        }
+    }
+
+  if (!woke_reader && w != NULL && rw->readers == 0)
+    {
+      list_remove (&w->elem);
+      thread_unblock (w);
+    }
+}
+
+/* Acquires RW for reading, sleeping until no writer holds it and
+   no writer of equal or higher priority is waiting for it.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_read_acquire (struct rwlock *rw)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (rw->writer != cur);
+
+  old_level = intr_disable ();
+#if LOCK_STATS
+  bool contended = rwlock_reader_must_wait (rw, cur);
+  int64_t wait_start = timer_ticks ();
+#endif
+  while (rwlock_reader_must_wait (rw, cur))
+    {
+      /* If we only defer to a waiting writer, make sure that
+         writer is not asleep with the lock free. */
+      if (rw->writer == NULL && rw->readers == 0)
+        rwlock_wake (rw);
+      list_push_back (&rw->read_waiters, &cur->elem);
+      thread_block ();
+    }
+  rw->readers++;
+#if LOCK_STATS
+  stats_acquired (&rw->stats, contended, wait_start);
+#endif
+  intr_set_level (old_level);
+}
+
+/* Releases RW, which the current thread holds for reading. */
+void
+rwlock_read_release (struct rwlock *rw)
+{
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+
+  old_level = intr_disable ();
+  ASSERT (rw->readers > 0);
+  if (--rw->readers == 0)
+    rwlock_wake (rw);
+  intr_set_level (old_level);
+
+  if (old_level == INTR_ON)
+    thread_preempt ();
+}
+
+/* Acquires RW for writing, sleeping until no other thread holds
+   it.  RW must not already be held by the current thread.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_write_acquire (struct rwlock *rw)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (rw->writer != cur);
+
+  old_level = intr_disable ();
+#if LOCK_STATS
+  bool contended = rw->writer != NULL || rw->readers > 0;
+  int64_t wait_start = timer_ticks ();
+#endif
+  while (rw->writer != NULL || rw->readers > 0)
+    {
+      list_push_back (&rw->write_waiters, &cur->elem);
+      thread_block ();
+    }
+  rw->writer = cur;
+#if LOCK_STATS
+  stats_acquired (&rw->stats, contended, wait_start);
+#endif
+  intr_set_level (old_level);
+}
+
+/* Releases RW, which the current thread holds for writing. */
+void
+rwlock_write_release (struct rwlock *rw)
+{
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+  ASSERT (rwlock_write_held_by_current_thread (rw));
+
+  old_level = intr_disable ();
+#if LOCK_STATS
+  stats_released (&rw->stats);
+#endif
+  rw->writer = NULL;
+  rwlock_wake (rw);
+  intr_set_level (old_level);
+
+  if (old_level == INTR_ON)
+    thread_preempt ();
+}
+
+/* Returns true if the current thread holds RW for writing, false
+   otherwise. */
+bool
+rwlock_write_held_by_current_thread (const struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  return rw->writer == thread_current ();
+}
+
+#if LOCK_STATS
+/* Names LOCK and adds it to the contention report printed by
+   lock_print_stats().  NAME must stay valid for as long as LOCK
+   exists. */
+void
+lock_set_name (struct lock *lock, const char *name)
+{
+  enum intr_level old_level;
+
+  ASSERT (lock != NULL);
+  ASSERT (name != NULL);
+
+  old_level = intr_disable ();
+  if (lock->stats.name == NULL)
+    list_push_back (&named_locks, &lock->stats.elem);
+  lock->stats.name = name;
+  intr_set_level (old_level);
+}
+
+/* Names RW and adds it to the contention report printed by
+   lock_print_stats().  NAME must stay valid for as long as RW
+   exists. */
+void
+rwlock_set_name (struct rwlock *rw, const char *name)
+{
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+  ASSERT (name != NULL);
+
+  old_level = intr_disable ();
+  if (rw->stats.name == NULL)
+    list_push_back (&named_locks, &rw->stats.elem);
+  rw->stats.name = name;
+  intr_set_level (old_level);
+}
+
+/* Prints contention statistics for every named lock. */
+void
+lock_print_stats (void)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&named_locks); e != list_end (&named_locks);
+       e = list_next (e))
+    {
+      struct lock_stats *st = list_entry (e, struct lock_stats, elem);
+      printf ("Lock %s: %u acquisitions, %u contended, "
+              "%lld wait ticks (max %lld), max hold %lld ticks\n",
+              st->name, st->acquisitions, st->contended,
+              st->wait_ticks, st->max_wait_ticks, st->max_hold_ticks);
+    }
+}
+
+/* Initializes ST for an unnamed lock. */
+static void
+stats_init (struct lock_stats *st)
+{
+  memset (st, 0, sizeof *st);
+}
+
+/* Records an acquisition that started waiting at WAIT_START.
+   CONTENDED is true if the lock was unavailable at first.
+   Interrupts must be off. */
+static void
+stats_acquired (struct lock_stats *st, bool contended, int64_t wait_start)
+{
+  int64_t now = timer_ticks ();
+
+  st->acquisitions++;
+  if (contended)
+    {
+      int64_t wait = now - wait_start;
+      st->contended++;
+      st->wait_ticks += wait;
+      if (wait > st->max_wait_ticks)
+        st->max_wait_ticks = wait;
+    }
+  st->acquired_at = now;
+}
+
+/* Records a release by the thread that acquired the lock last.
+   Interrupts must be off. */
+static void
+stats_released (struct lock_stats *st)
+{
+  int64_t hold = timer_ticks () - st->acquired_at;
+
+  if (hold > st->max_hold_ticks)
+    st->max_hold_ticks = hold;
+}
+#endif /* LOCK_STATS */
+
 /* One semaphore in a list. */
 struct semaphore_elem
   {
     struct list_elem elem;              /* List element. */
     struct semaphore semaphore;         /* This semaphore. */
+    struct thread *thread;              /* Thread waiting on it. */
   };
 
+static struct semaphore_elem *cond_max_waiter (struct condition *);
+
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -295,15 +862,54 @@ cond_wait (struct condition *cond, struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
 
   sema_init (&waiter.semaphore, 0);
+  waiter.thread = thread_current ();
   list_push_back (&cond->waiters, &waiter.elem);
   lock_release (lock);
   sema_down (&waiter.semaphore);
   lock_acquire (lock);
 }
 
+/* Like cond_wait(), but gives up waiting for a signal after
+   TICKS timer ticks.  Returns true if COND was signaled, false
+   if the time ran out first.  Either way, LOCK is held again on
+   return; reacquiring it is not subject to the timeout.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool
+cond_wait_timeout (struct condition *cond, struct lock *lock, int64_t ticks)
+{
+  struct semaphore_elem waiter;
+  bool signaled;
+
+  ASSERT (cond != NULL);
+  ASSERT (lock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (lock_held_by_current_thread (lock));
+
+  sema_init (&waiter.semaphore, 0);
+  waiter.thread = thread_current ();
+  list_push_back (&cond->waiters, &waiter.elem);
+  lock_release (lock);
+  signaled = sema_down_timeout (&waiter.semaphore, ticks);
+  lock_acquire (lock);
+
+  /* A signal that came after the timeout but before we got LOCK
+     back still counts.  Otherwise we are still on COND's wait
+     list; signalers hold LOCK, so it is safe to remove
+     ourselves now. */
+  if (!signaled)
+    {
+      signaled = sema_try_down (&waiter.semaphore);
+      if (!signaled)
+        list_remove (&waiter.elem);
+    }
+  return signaled;
+}
+
 /* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
-   LOCK must be held before calling this function.
+   this function signals the one with the highest priority to
+   wake up from its wait.  LOCK must be held before calling this function.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to signal a condition variable within an
@@ -317,12 +923,15 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
   ASSERT (lock_held_by_current_thread (lock));
 
   if (!list_empty (&cond->waiters))
-    sema_up (&list_entry (list_pop_front (&cond->waiters),
-                          struct semaphore_elem, elem)->semaphore);
+    {
+      struct semaphore_elem *waiter = cond_max_waiter (cond);
+      list_remove (&waiter->elem);
+      sema_up (&waiter->semaphore);
+    }
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
-   LOCK).  LOCK must be held before calling this function.
+   LOCK), in priority order.  LOCK must be held before calling this function.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to signal a condition variable within an
@@ -330,9 +939,39 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
 void
 cond_broadcast (struct condition *cond, struct lock *lock)
 {
+  enum intr_level old_level;
+
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
 
+  /* Wake everyone with interrupts off, so that each wakeup only
+     queues its thread, and yield at most once at the end. */
+  old_level = intr_disable ();
   while (!list_empty (&cond->waiters))
     cond_signal (cond, lock);
+  intr_set_level (old_level);
+
+  if (old_level == INTR_ON)
+    thread_preempt ();
+}
+
+/* Returns COND's waiter with the highest priority, the
+   longest-waiting one among equals.  A waiter's priority can
+   change through donation while it waits, so the list is not
+   kept sorted but scanned when it is signaled.  COND must have
+   at least one waiter. */
+static struct semaphore_elem *
+cond_max_waiter (struct condition *cond)
+{
+  struct semaphore_elem *max = NULL;
+  struct list_elem *e;
+
+  for (e = list_begin (&cond->waiters); e != list_end (&cond->waiters);
+       e = list_next (e))
+    {
+      struct semaphore_elem *w = list_entry (e, struct semaphore_elem, elem);
+      if (max == NULL || w->thread->priority > max->thread->priority)
+        max = w;
+    }
+  return max;
 }
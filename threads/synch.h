@@ -3,6 +3,31 @@
 
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
+
+/* Set to 1 to collect contention statistics for locks and
+   reader-writer locks that have been given a name, reported at
+   shutdown.  At 0 the counters are compiled out entirely and
+   naming a lock does nothing. */
+#ifndef LOCK_STATS
+#define LOCK_STATS 0
+#endif
+
+#if LOCK_STATS
+/* Contention statistics for one lock.  Times are in timer
+   ticks. */
+struct lock_stats
+  {
+    const char *name;           /* Name in the report, or NULL. */
+    struct list_elem elem;      /* Element in list of named locks. */
+    unsigned acquisitions;      /* # of times acquired. */
+    unsigned contended;         /* # of acquisitions that had to wait. */
+    int64_t wait_ticks;         /* Total time spent waiting. */
+    int64_t max_wait_ticks;     /* Longest wait. */
+    int64_t max_hold_ticks;     /* Longest time held (writers only). */
+    int64_t acquired_at;        /* When last acquired. */
+  };
+#endif
 
 /* A counting semaphore. */
 struct semaphore
@@ -13,23 +38,60 @@ struct semaphore
 
 void sema_init (struct semaphore *, unsigned value);
 void sema_down (struct semaphore *);
+bool sema_down_timeout (struct semaphore *, int64_t ticks);
 bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
+void sema_up_handoff (struct semaphore *);
 void sema_self_test (void);
 
 /* Lock. */
 struct lock
   {
-    struct thread *holder;      /* Thread holding lock (for debugging). */
+    struct thread *holder;      /* Thread holding lock. */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+    struct list_elem elem;      /* Element in holder's held_locks. */
+#if LOCK_STATS
+    struct lock_stats stats;    /* Contention statistics. */
+#endif
   };
 
 void lock_init (struct lock *);
 void lock_acquire (struct lock *);
+bool lock_acquire_timeout (struct lock *, int64_t ticks);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
 
+/* Reader-writer lock. */
+struct rwlock
+  {
+    unsigned readers;           /* # of threads holding it to read. */
+    struct thread *writer;      /* Thread holding it to write, or NULL. */
+    struct list read_waiters;   /* Threads waiting to read. */
+    struct list write_waiters;  /* Threads waiting to write. */
+#if LOCK_STATS
+    struct lock_stats stats;    /* Contention statistics. */
+#endif
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_read_acquire (struct rwlock *);
+void rwlock_read_release (struct rwlock *);
+void rwlock_write_acquire (struct rwlock *);
+void rwlock_write_release (struct rwlock *);
+bool rwlock_write_held_by_current_thread (const struct rwlock *);
+
+/* Lock contention statistics. */
+#if LOCK_STATS
+void lock_set_name (struct lock *, const char *name);
+void rwlock_set_name (struct rwlock *, const char *name);
+void lock_print_stats (void);
+#else
+#define lock_set_name(LOCK, NAME) ((void) 0)
+#define rwlock_set_name(RWLOCK, NAME) ((void) 0)
+#define lock_print_stats() ((void) 0)
+#endif
+
 /* Condition variable. */
 struct condition
   {
@@ -38,6 +100,7 @@ struct condition
 
 void cond_init (struct condition *);
 void cond_wait (struct condition *, struct lock *);
+bool cond_wait_timeout (struct condition *, struct lock *, int64_t ticks);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
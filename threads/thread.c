@@ -4,12 +4,15 @@
 #include <random.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
+#include "threads/fixed-point.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
 #include "threads/palloc.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #include "lib/log.h"
 #ifdef USERPROG
@@ -21,22 +24,52 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* A run queue: processes in THREAD_READY state, that is,
+   processes that are ready to run but not actually running.
+
+   Under the priority schedulers there is one list per priority
+   level; bit P of MASK is set if and only if LISTS[P] is
+   nonempty, so finding the highest-priority ready thread is a
+   single bit scan.  Under the fair scheduler, ready threads are
+   instead kept in BY_VRUNTIME, a red-black tree ordered by
+   virtual runtime, so that a thread is queued in O(log n) time
+   and the next one to run is found in O(1). */
+struct runqueue
+  {
+    struct list lists[PRI_MAX + 1];
+    uint64_t mask;
+    struct rb_tree by_vruntime; /* Ready threads (cfs only). */
+    int64_t min_vruntime;       /* Monotonic floor of vruntimes (cfs). */
+    unsigned load;              /* Sum of ready threads' weights (cfs). */
+    int count;                  /* # of ready threads. */
+  };
 
-/* List of all processes.  Processes are added to this list
-   when they are first scheduled and removed when they exit. */
-static struct list all_list;
+/* Threads ready to run. */
+static struct runqueue ready_queue;
 
 /* Idle thread. */
 static struct thread *idle_thread;
 
+/* List of all processes.  Processes are added to this list
+   when they are first scheduled and removed when they exit. */
+static struct list all_list;
+
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
 
-/* Lock used by allocate_tid(). */
-static struct lock tid_lock;
+/* Cache of free thread pages.  Recycling the page of a dead
+   thread, instead of returning it to the page allocator and
+   getting a fresh zeroed one, skips the allocator's lock and
+   bitmap scan and the zeroing of the whole page.  Accessed only
+   with interrupts off, because thread_schedule_tail() cannot
+   sleep.  The "thread-cache" kernel thread tops the cache up in
+   the background when it runs low. */
+#define PAGE_CACHE_MAX 16       /* Most pages kept in the cache. */
+#define PAGE_CACHE_LOW 4        /* Refill when fewer pages than this. */
+static void *page_cache[PAGE_CACHE_MAX];
+static size_t page_cache_cnt;
+static struct semaphore page_cache_refill; /* Upped to request a refill. */
+static bool page_cache_refill_pending;     /* Refill requested, not done. */
 
 /* Stack frame for kernel_thread(). */
 struct kernel_thread_frame
@@ -50,6 +83,9 @@ struct kernel_thread_frame
 static long long idle_ticks;    /* # of timer ticks spent idle. */
 static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
 static long long user_ticks;    /* # of timer ticks in user programs. */
+static unsigned latency_hist[LATENCY_BUCKETS]; /* All threads' ready waits. */
+static bool preempting;         /* Is the next yield a preemption? */
+static unsigned handoff_cnt;    /* # of direct switches by thread_handoff(). */
 
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
@@ -60,6 +96,30 @@ static unsigned thread_ticks;   /* # of timer ticks since last yield. */
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* If true, use the completely fair scheduler instead.
+   Controlled by kernel command-line option "-cfs".
+
+   Each thread accumulates virtual runtime: one tick of CPU time
+   adds CFS_NICE_0_WEIGHT * CFS_VTICK / weight, where the weight
+   follows from the thread's (effective) priority, so higher
+   priority threads age more slowly and receive a proportionally
+   larger share of the CPU.  The ready thread with the least
+   virtual runtime runs next.  Its slice is its weighted share of
+   a scheduling period that targets CFS_LATENCY ticks, but never
+   less than CFS_MIN_GRANULARITY ticks per ready thread. */
+bool thread_cfs;
+
+#define CFS_VTICK 1024          /* Vruntime of a tick at nice-0 weight. */
+#define CFS_NICE_0_WEIGHT 1024  /* Weight of a PRI_DEFAULT thread. */
+#define CFS_LATENCY 8           /* Target scheduling period, in ticks. */
+#define CFS_MIN_GRANULARITY 1   /* Shortest slice, in ticks. */
+#define CFS_WAKEUP_GRAN CFS_VTICK   /* Lead needed to preempt on wakeup. */
+#define CFS_SLEEPER_BONUS (CFS_LATENCY * CFS_VTICK / 2) /* Wakeup credit. */
+
+/* Multi-level feedback queue scheduler. */
+#define MLFQS_PRIORITY_TICKS 4  /* # of ticks between priority updates. */
+static fixed_point load_avg;    /* System load average. */
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
@@ -69,15 +129,39 @@ static void init_thread (struct thread *, const char *name, int priority);
 static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
+static void schedule_to (struct thread *next);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static void runqueue_init (struct runqueue *);
+static struct thread *runqueue_pop (struct runqueue *);
+static int runqueue_max_priority (const struct runqueue *);
+static bool vruntime_less (const struct rb_elem *,
+                           const struct rb_elem *, void *aux);
+static unsigned cfs_weight (int priority);
+static void cfs_tick (struct thread *);
+static unsigned cfs_slice (struct thread *);
+static void ready_push (struct thread *);
+static void ready_remove (struct thread *);
+static int ready_max_priority (void);
+static bool ready_should_preempt (void);
+static void set_priority (struct thread *, int priority);
+static void mlfqs_tick (struct thread *);
+static void mlfqs_update_priority (struct thread *);
+static void mlfqs_decay_recent_cpu (struct thread *, void *coef);
+static void preempt_running (void);
+static void stats_switch (struct thread *cur, struct thread *next);
+static void print_latency_hist (const unsigned hist[LATENCY_BUCKETS]);
+static void print_thread_stats (struct thread *, void *aux);
+static struct thread *alloc_thread_page (void);
+static void free_thread_page (struct thread *);
+static thread_func page_cache_refiller NO_RETURN;
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
    general and it is possible in this case only because loader.S
    was careful to put the bottom of the stack at a page boundary.
 
-   Also initializes the run queue and the tid lock.
+   Also initializes the run queue and the thread page cache.
 
    After calling this function, be sure to initialize the page
    allocator before trying to create any threads with
@@ -90,8 +174,12 @@ thread_init (void)
 {
   ASSERT (intr_get_level () == INTR_OFF);
 
-  lock_init (&tid_lock);
-  list_init (&ready_list);
+  sema_init (&page_cache_refill, 0);
+  page_cache_refill_pending = false;
+  page_cache_cnt = 0;
+  runqueue_init (&ready_queue);
+  idle_thread = NULL;
+  load_avg = 0;
   list_init (&all_list);
 
   /* Set up a thread structure for the running thread. */
@@ -102,7 +190,8 @@ thread_init (void)
 }
 
 /* Starts preemptive thread scheduling by enabling interrupts.
-   Also creates the idle thread. */
+   Also creates the idle thread and the thread that refills the
+   thread page cache. */
 void
 thread_start (void)
 {
@@ -117,6 +206,8 @@ thread_start (void)
 
   /* Wait for the idle thread to initialize idle_thread. */
   sema_down (&idle_started);
+
+  thread_create ("thread-cache", PRI_MIN, page_cache_refiller, NULL);
 }
 
 /* Called by the timer interrupt handler at each timer tick.
@@ -136,17 +227,33 @@ thread_tick (void)
   else
     kernel_ticks++;
 
+  if (thread_mlfqs)
+    mlfqs_tick (t);
+
+  if (thread_cfs && t != idle_thread)
+    cfs_tick (t);
+
   /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
-    intr_yield_on_return ();
+  if (++thread_ticks >= (thread_cfs ? cfs_slice (t) : TIME_SLICE))
+    preempt_running ();
 }
 
-/* Prints thread statistics. */
+/* Prints thread statistics, including scheduling statistics for
+   each thread that is still alive. */
 void
 thread_print_stats (void)
 {
+  enum intr_level old_level;
+
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
           idle_ticks, kernel_ticks, user_ticks);
+  printf ("Thread: runqueue latency in ticks:");
+  print_latency_hist (latency_hist);
+  printf ("Thread: %u direct handoffs\n", handoff_cnt);
+
+  old_level = intr_disable ();
+  thread_foreach (print_thread_stats, NULL);
+  intr_set_level (old_level);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -161,9 +268,8 @@ thread_print_stats (void)
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
 
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   If the new thread has a higher priority than the running
+   thread, it preempts the running thread immediately. */
 tid_t
 thread_create (const char *name, int priority,
                thread_func *function, void *aux)
@@ -177,7 +283,7 @@ thread_create (const char *name, int priority,
   ASSERT (function != NULL);
 
   /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  t = alloc_thread_page ();
   if (t == NULL)
     return TID_ERROR;
 
@@ -185,11 +291,24 @@ thread_create (const char *name, int priority,
   init_thread (t, name, priority);
   tid = t->tid = allocate_tid ();
 
-  t->parent_sema = palloc_get_page(0);
-  sema_init(t->parent_sema, 0);
-  thread_current()->child_thread = t;
-  thread_current()->parent_sema = t->parent_sema;
-  
+  /* Under the 4.4BSD scheduler the PRIORITY argument is ignored:
+     the child inherits its parent's nice and recent_cpu values
+     and its priority follows from them. */
+  if (thread_mlfqs)
+    {
+      struct thread *cur = thread_current ();
+      enum intr_level old_level = intr_disable ();
+      t->nice = cur->nice;
+      t->recent_cpu = cur->recent_cpu;
+      mlfqs_update_priority (t);
+      intr_set_level (old_level);
+    }
+
+  /* Under the fair scheduler a new thread starts level with the
+     least virtual runtime in the run queue, instead of at 0, which would
+     let it monopolize the CPU until it caught up. */
+  if (thread_cfs)
+    t->vruntime = ready_queue.min_vruntime;
 
   /* Stack frame for kernel_thread(). */
   kf = alloc_frame (t, sizeof *kf);
@@ -226,6 +345,7 @@ thread_block (void)
   ASSERT (!intr_context ());
   ASSERT (intr_get_level () == INTR_OFF);
 
+  TRACE (BLOCK, __builtin_return_address (0), 0);
   thread_current ()->status = THREAD_BLOCKED;
   schedule ();
 }
@@ -234,22 +354,117 @@ thread_block (void)
    This is an error if T is not blocked.  (Use thread_yield() to
    make the running thread ready.)
 
-   This function does not preempt the running thread.  This can
-   be important: if the caller had disabled interrupts itself,
-   it may expect that it can atomically unblock a thread and
-   update other data. */
+   If T has a higher priority than the running thread, the
+   running thread is preempted: at the end of the interrupt if
+   called from an interrupt handler, or right away if interrupts
+   were on.  If the caller had disabled interrupts itself, it may
+   expect that it can atomically unblock a thread and update
+   other data, so in that case the running thread is not
+   preempted here; call thread_preempt() once interrupts are
+   back on. */
 void
 thread_unblock (struct thread *t)
 {
   enum intr_level old_level;
+  int64_t now;
 
   ASSERT (is_thread (t));
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
+  TRACE (UNBLOCK, t->tid, 0);
+  now = timer_ticks ();
+  t->stats.blocked_ticks += now - t->stats.since;
+  t->stats.since = now;
+  if (thread_cfs)
+    {
+      /* Give a thread that slept a little credit, but not enough
+         to starve the others while it catches up. */
+      int64_t floor = ready_queue.min_vruntime - CFS_SLEEPER_BONUS;
+      if (t->vruntime < floor)
+        t->vruntime = floor;
+    }
+  ready_push (t);
+  t->status = THREAD_READY;
+  intr_set_level (old_level);
+
+  if (old_level == INTR_ON || intr_context ())
+    thread_preempt ();
+}
+
+/* Wakes blocked thread T on behalf of a running thread that is
+   about to block or yield, such as one that just woke a waiter
+   for its reply.  If T's priority is at least as high as that of
+   the running thread and of every ready thread, switches to T
+   directly, without passing it through the run queue, and puts
+   the running thread on the run queue instead.  Otherwise, acts
+   like thread_unblock().
+
+   Interrupts must be off, and this function must not be called
+   from an interrupt handler.  The fair scheduler orders threads
+   by virtual runtime, not priority, so under it this function
+   never hands off. */
+void
+thread_handoff (struct thread *t)
+{
+  struct thread *cur = thread_current ();
+  int64_t now;
+
+  ASSERT (is_thread (t));
+  ASSERT (!intr_context ());
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->status == THREAD_BLOCKED);
+
+  if (thread_cfs || t->priority < cur->priority
+      || t->priority < ready_max_priority ())
+    {
+      thread_unblock (t);
+      return;
+    }
+
+  TRACE (UNBLOCK, t->tid, 0);
+  now = timer_ticks ();
+  t->stats.blocked_ticks += now - t->stats.since;
+  t->stats.since = now;
   t->status = THREAD_READY;
+
+  ready_push (cur);
+  cur->status = THREAD_READY;
+  handoff_cnt++;
+  schedule_to (t);
+}
+
+/* Yields the CPU if a ready thread has a higher priority than
+   the running thread.  Within an interrupt handler, the yield
+   happens just before the interrupt returns. */
+void
+thread_preempt (void)
+{
+  enum intr_level old_level = intr_disable ();
+  bool preempt = ready_should_preempt ();
   intr_set_level (old_level);
+
+  if (preempt)
+    preempt_running ();
+}
+
+/* Preempts the running thread: just before the interrupt returns
+   if called from an interrupt handler, otherwise right away. */
+static void
+preempt_running (void)
+{
+  /* The idle thread blocks again as soon as any interrupt wakes
+     it, so it never needs to be preempted.  Letting it switch
+     away from inside an interrupt would also skip
+     timer_idle_exit(). */
+  if (running_thread () == idle_thread)
+    return;
+
+  preempting = true;
+  if (intr_context ())
+    intr_yield_on_return ();
+  else
+    thread_yield ();
 }
 
 /* Returns the name of the running thread. */
@@ -318,7 +533,7 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (cur != idle_thread)
-    list_push_back (&ready_list, &cur->elem);
+    ready_push (cur);
   cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
@@ -341,11 +556,86 @@ thread_foreach (thread_action_func *func, void *aux)
     }
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's base priority to NEW_PRIORITY.  Its
+   effective priority stays raised while it holds donations.
+   Yields if the running thread no longer has the highest
+   priority.
+   Ignored under the multi-level feedback queue scheduler, which
+   computes priorities itself. */
 void
 thread_set_priority (int new_priority)
 {
-  thread_current ()->priority = new_priority;
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+
+  if (thread_mlfqs)
+    return;
+
+  old_level = intr_disable ();
+  cur->base_priority = new_priority;
+  thread_refresh_priority (cur);
+  intr_set_level (old_level);
+
+  thread_preempt ();
+}
+
+/* Raises T's effective priority to PRIORITY, which a thread
+   waiting on a lock that T holds is donating to it.  Has no
+   effect if T's priority is already at least PRIORITY.
+   Interrupts must be off. */
+void
+thread_donate_priority (struct thread *t, int priority)
+{
+  ASSERT (is_thread (t));
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (priority > t->priority)
+    set_priority (t, priority);
+}
+
+/* Recomputes T's effective priority as the highest of its base
+   priority and the priorities donated by the threads waiting on
+   the locks it still holds.  Each lock's wait list is in
+   priority order, so only its first waiter needs to be looked
+   at.  Interrupts must be off. */
+void
+thread_refresh_priority (struct thread *t)
+{
+  int priority = t->base_priority;
+  struct list_elem *le;
+
+  ASSERT (is_thread (t));
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (le = list_begin (&t->held_locks); le != list_end (&t->held_locks);
+       le = list_next (le))
+    {
+      struct lock *lock = list_entry (le, struct lock, elem);
+      struct list *waiters = &lock->semaphore.waiters;
+
+      if (!list_empty (waiters))
+        {
+          struct thread *w = list_entry (list_front (waiters),
+                                         struct thread, elem);
+          if (w->priority > priority)
+            priority = w->priority;
+        }
+    }
+  set_priority (t, priority);
+}
+
+/* Returns true if the thread whose `elem' is A has a higher
+   priority than the one whose `elem' is B.  Used with
+   list_insert_ordered() to keep wait lists in descending
+   priority order, first come first served among equals. */
+bool
+thread_priority_greater (const struct list_elem *a,
+                         const struct list_elem *b, void *aux UNUSED)
+{
+  return (list_entry (a, struct thread, elem)->priority
+          > list_entry (b, struct thread, elem)->priority);
 }
 
 /* Returns the current thread's priority. */
@@ -355,37 +645,54 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE and recomputes
+   its priority, yielding if it no longer has the highest
+   priority. */
 void
-thread_set_nice (int nice UNUSED)
+thread_set_nice (int nice)
 {
-  /* Not yet implemented. */
+  enum intr_level old_level;
+
+  ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+  old_level = intr_disable ();
+  thread_current ()->nice = nice;
+  if (thread_mlfqs)
+    mlfqs_update_priority (thread_current ());
+  intr_set_level (old_level);
+
+  thread_preempt ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int load_avg_100 = fp_round (load_avg * 100);
+  intr_set_level (old_level);
+
+  return load_avg_100;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int recent_cpu_100 = fp_round (thread_current ()->recent_cpu * 100);
+  intr_set_level (old_level);
+
+  return recent_cpu_100;
 }
-
+
 /* Idle thread.  Executes when no other thread is ready to run.
 
    The idle thread is initially put on the ready list by
@@ -406,6 +713,7 @@ idle (void *idle_started_ UNUSED)
     {
       /* Let someone else run. */
       intr_disable ();
+      timer_idle_exit ();
       thread_block ();
 
       /* Re-enable interrupts and wait for the next one.
@@ -419,7 +727,12 @@ idle (void *idle_started_ UNUSED)
          time.
 
          See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
-         7.11.1 "HLT Instruction". */
+         7.11.1 "HLT Instruction".
+
+         In tickless mode, the periodic timer interrupt is
+         stopped until the next deadline first. */
+      timer_idle_enter ();
+      intr_trace_sti ();
       asm volatile ("sti; hlt" : : : "memory");
     }
 }
@@ -472,6 +785,14 @@ init_thread (struct thread *t, const char *name, int priority)
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
   t->priority = priority;
+  t->base_priority = priority;
+  list_init (&t->held_locks);
+#ifdef USERPROG
+  list_init (&t->children);
+#endif
+  t->nice = NICE_DEFAULT;
+  t->recent_cpu = 0;
+  t->stats.since = timer_ticks ();
   t->magic = THREAD_MAGIC;
 
   old_level = intr_disable ();
@@ -492,18 +813,334 @@ alloc_frame (struct thread *t, size_t size)
   return t->stack;
 }
 
+/* Initializes RQ as an empty run queue. */
+static void
+runqueue_init (struct runqueue *rq)
+{
+  int i;
+
+  for (i = 0; i <= PRI_MAX; i++)
+    list_init (&rq->lists[i]);
+  rq->mask = 0;
+  rb_init (&rq->by_vruntime, vruntime_less, NULL);
+  rq->min_vruntime = 0;
+  rq->load = 0;
+  rq->count = 0;
+}
+
+/* Removes and returns the thread that should run next from RQ,
+   which must not be empty: the first thread of the highest
+   priority, or under the fair scheduler the thread with the
+   least virtual runtime.  Interrupts must be off. */
+static struct thread *
+runqueue_pop (struct runqueue *rq)
+{
+  struct thread *t;
+
+  ASSERT (rq->count > 0);
+
+  if (thread_cfs)
+    {
+      t = rb_entry (rb_min (&rq->by_vruntime), struct thread, vruntime_elem);
+      rb_remove (&rq->by_vruntime, &t->vruntime_elem);
+      rq->load -= cfs_weight (t->priority);
+    }
+  else
+    {
+      int priority = runqueue_max_priority (rq);
+      t = list_entry (list_pop_front (&rq->lists[priority]),
+                      struct thread, elem);
+      if (list_empty (&rq->lists[priority]))
+        rq->mask &= ~((uint64_t) 1 << priority);
+    }
+  rq->count--;
+  return t;
+}
+
+/* Returns the highest priority that has a ready thread in RQ, or
+   -1 if RQ is empty.  Interrupts must be off. */
+static int
+runqueue_max_priority (const struct runqueue *rq)
+{
+  uint32_t hi = rq->mask >> 32;
+  uint32_t lo = rq->mask;
+
+  /* Scan the two halves separately: a 64-bit count-leading-zeros
+     would need libgcc, which the kernel does not link against. */
+  if (hi != 0)
+    return 63 - __builtin_clz (hi);
+  else if (lo != 0)
+    return 31 - __builtin_clz (lo);
+  else
+    return -1;
+}
+
+/* Appends T to the run queue for its priority.
+   Interrupts must be off. */
+static void
+ready_push (struct thread *t)
+{
+  struct runqueue *rq = &ready_queue;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (thread_cfs)
+    {
+      rb_insert (&rq->by_vruntime, &t->vruntime_elem);
+      rq->load += cfs_weight (t->priority);
+    }
+  else
+    {
+      list_push_back (&rq->lists[t->priority], &t->elem);
+      rq->mask |= (uint64_t) 1 << t->priority;
+    }
+  rq->count++;
+}
+
+/* Removes ready thread T from the run queue.  Interrupts must be
+   off. */
+static void
+ready_remove (struct thread *t)
+{
+  struct runqueue *rq = &ready_queue;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->status == THREAD_READY);
+
+  if (thread_cfs)
+    {
+      rb_remove (&rq->by_vruntime, &t->vruntime_elem);
+      rq->load -= cfs_weight (t->priority);
+    }
+  else
+    {
+      list_remove (&t->elem);
+      if (list_empty (&rq->lists[t->priority]))
+        rq->mask &= ~((uint64_t) 1 << t->priority);
+    }
+  rq->count--;
+}
+
+/* Returns the highest priority that has a ready thread, or -1
+   if the run queue is empty.  Interrupts must be off. */
+static int
+ready_max_priority (void)
+{
+  return runqueue_max_priority (&ready_queue);
+}
+
+/* Returns true if a ready thread has a higher priority than the
+   running thread, or under the fair scheduler, if a ready thread
+   has run for sufficiently less virtual time.  Interrupts must be
+   off. */
+static bool
+ready_should_preempt (void)
+{
+  if (thread_cfs)
+    {
+      struct runqueue *rq = &ready_queue;
+      struct thread *first;
+
+      if (rb_empty (&rq->by_vruntime))
+        return false;
+      first = rb_entry (rb_min (&rq->by_vruntime), struct thread,
+                        vruntime_elem);
+      return (first->vruntime + CFS_WAKEUP_GRAN
+              < running_thread ()->vruntime);
+    }
+  return ready_max_priority () > running_thread ()->priority;
+}
+
 /* Chooses and returns the next thread to be scheduled.  Should
    return a thread from the run queue, unless the run queue is
    empty.  (If the running thread can continue running, then it
    will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+   idle_thread.  Threads of equal priority are chosen round
+   robin. */
 static struct thread *
 next_thread_to_run (void)
 {
-  if (list_empty (&ready_list))
-    return idle_thread;
+  if (ready_queue.count > 0)
+    return runqueue_pop (&ready_queue);
+  return idle_thread;
+}
+
+/* Returns true if the thread whose `vruntime_elem' is A has less
+   virtual runtime than the one whose `vruntime_elem' is B. */
+static bool
+vruntime_less (const struct rb_elem *a, const struct rb_elem *b,
+               void *aux UNUSED)
+{
+  return (rb_entry (a, struct thread, vruntime_elem)->vruntime
+          < rb_entry (b, struct thread, vruntime_elem)->vruntime);
+}
+
+/* Returns the fair scheduler weight for PRIORITY.  The priority
+   range is mapped onto Linux's nice range, -20 to 19, with
+   PRI_DEFAULT at nice 0, and each nice step changes the weight
+   by about 25%. */
+static unsigned
+cfs_weight (int priority)
+{
+  static const unsigned nice_to_weight[40] =
+    {
+      /* -20 */ 88761, 71755, 56483, 46273, 36291,
+      /* -15 */ 29154, 23254, 18705, 14949, 11916,
+      /* -10 */  9548,  7620,  6100,  4904,  3906,
+      /*  -5 */  3121,  2501,  1991,  1586,  1277,
+      /*   0 */  1024,   820,   655,   526,   423,
+      /*   5 */   335,   272,   215,   172,   137,
+      /*  10 */   110,    87,    70,    56,    45,
+      /*  15 */    36,    29,    23,    18,    15,
+    };
+  int nice = (PRI_DEFAULT - priority) * 20 / (PRI_MAX - PRI_DEFAULT);
+
+  if (nice < -20)
+    nice = -20;
+  else if (nice > 19)
+    nice = 19;
+  return nice_to_weight[nice + 20];
+}
+
+/* Fair scheduler bookkeeping for one timer tick, while CUR is
+   running: charges CUR one tick of weighted virtual runtime and
+   advances the run queue's minimum virtual runtime.  Runs in an
+   external interrupt context. */
+static void
+cfs_tick (struct thread *cur)
+{
+  struct runqueue *rq = &ready_queue;
+  int64_t min;
+
+  cur->vruntime += (CFS_NICE_0_WEIGHT * CFS_VTICK
+                    / cfs_weight (cur->priority));
+
+  min = cur->vruntime;
+  if (!rb_empty (&rq->by_vruntime))
+    {
+      struct thread *first = rb_entry (rb_min (&rq->by_vruntime),
+                                       struct thread, vruntime_elem);
+      if (first->vruntime < min)
+        min = first->vruntime;
+    }
+  if (min > rq->min_vruntime)
+    rq->min_vruntime = min;
+}
+
+/* Returns the length of running thread CUR's slice, in ticks:
+   its weighted share of the scheduling period. */
+static unsigned
+cfs_slice (struct thread *cur)
+{
+  struct runqueue *rq = &ready_queue;
+  unsigned weight = cfs_weight (cur->priority);
+  unsigned runnable = rq->count + 1;
+  unsigned period = CFS_LATENCY;
+  unsigned slice;
+
+  if (runnable * CFS_MIN_GRANULARITY > period)
+    period = runnable * CFS_MIN_GRANULARITY;
+  slice = period * weight / (rq->load + weight);
+  return slice > CFS_MIN_GRANULARITY ? slice : CFS_MIN_GRANULARITY;
+}
+
+/* Changes T's priority to PRIORITY, moving T to the matching run
+   queue if it is ready, or to its new place in its wait list if
+   it is blocked on a semaphore.  Does not preempt the running
+   thread.  Interrupts must be off. */
+static void
+set_priority (struct thread *t, int priority)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+  if (t->priority == priority)
+    return;
+  if (t->status == THREAD_READY)
+    {
+      ready_remove (t);
+      t->priority = priority;
+      ready_push (t);
+    }
+  else if (t->status == THREAD_BLOCKED && t->wait_queue != NULL)
+    {
+      list_remove (&t->elem);
+      t->priority = priority;
+      list_insert_ordered (t->wait_queue, &t->elem,
+                           thread_priority_greater, NULL);
+    }
   else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+    t->priority = priority;
+}
+
+/* Multi-level feedback queue scheduler bookkeeping for one timer
+   tick, while CUR is running.  Runs in an external interrupt
+   context.
+
+   Between once-per-second recalculations, only the running
+   thread's recent_cpu changes, so only its priority needs to be
+   recomputed every MLFQS_PRIORITY_TICKS ticks. */
+static void
+mlfqs_tick (struct thread *cur)
+{
+  int64_t now = timer_ticks ();
+
+  if (cur != idle_thread)
+    cur->recent_cpu = fp_add_int (cur->recent_cpu, 1);
+
+  if (now % TIMER_FREQ == 0)
+    {
+      int ready_threads = ready_queue.count + (cur != idle_thread ? 1 : 0);
+      fixed_point coef;
+
+      /* load_avg = (59/60) * load_avg + (1/60) * ready_threads. */
+      load_avg = (59 * load_avg + fp_from_int (ready_threads)) / 60;
+
+      /* recent_cpu decays by (2*load_avg) / (2*load_avg + 1). */
+      coef = fp_div (2 * load_avg, 2 * load_avg + FP_ONE);
+      thread_foreach (mlfqs_decay_recent_cpu, &coef);
+    }
+  else if (now % MLFQS_PRIORITY_TICKS == 0 && cur != idle_thread)
+    mlfqs_update_priority (cur);
+
+  if (ready_should_preempt ())
+    preempt_running ();
+}
+
+/* Recomputes T's priority from its recent_cpu and nice values.
+   Interrupts must be off. */
+static void
+mlfqs_update_priority (struct thread *t)
+{
+  int priority = PRI_MAX - fp_trunc (t->recent_cpu / 4) - t->nice * 2;
+
+  if (priority < PRI_MIN)
+    priority = PRI_MIN;
+  else if (priority > PRI_MAX)
+    priority = PRI_MAX;
+  t->base_priority = priority;
+  set_priority (t, priority);
+}
+
+/* Decays T's recent_cpu by the fixed-point factor *COEF_ and
+   adds T's nice value, as done once per second.  Recomputes T's
+   priority only if recent_cpu actually changed, which it does
+   not for a thread with no recent CPU time and nice 0. */
+static void
+mlfqs_decay_recent_cpu (struct thread *t, void *coef_)
+{
+  const fixed_point *coef = coef_;
+  fixed_point recent_cpu;
+
+  if (t == idle_thread)
+    return;
+
+  recent_cpu = fp_add_int (fp_mul (*coef, t->recent_cpu), t->nice);
+  if (recent_cpu != t->recent_cpu)
+    {
+      t->recent_cpu = recent_cpu;
+      mlfqs_update_priority (t);
+    }
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -548,7 +1185,89 @@ thread_schedule_tail (struct thread *prev)
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread)
     {
       ASSERT (prev != cur);
-      palloc_free_page (prev);
+      free_thread_page (prev);
+    }
+}
+
+/* Returns a page for a new thread, from the thread page cache if
+   possible, otherwise from the page allocator.  Only the `struct
+   thread' at the bottom of the page is cleared, by
+   init_thread(); the stack area keeps whatever it held.  Returns
+   a null pointer if no page is available. */
+static struct thread *
+alloc_thread_page (void)
+{
+  struct thread *t = NULL;
+  enum intr_level old_level;
+  bool refill;
+
+  /* Request a refill only once per pass of the refiller, so that
+     the semaphore does not count up while the cache stays low. */
+  old_level = intr_disable ();
+  if (page_cache_cnt > 0)
+    t = page_cache[--page_cache_cnt];
+  refill = page_cache_cnt < PAGE_CACHE_LOW && !page_cache_refill_pending;
+  if (refill)
+    page_cache_refill_pending = true;
+  intr_set_level (old_level);
+
+  if (refill)
+    sema_up (&page_cache_refill);
+  if (t == NULL)
+    t = palloc_get_page (0);
+  return t;
+}
+
+/* Returns dead thread T's page to the thread page cache, or to
+   the page allocator if the cache is full.  Interrupts must be
+   off. */
+static void
+free_thread_page (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (page_cache_cnt < PAGE_CACHE_MAX)
+    page_cache[page_cache_cnt++] = t;
+  else
+    palloc_free_page (t);
+}
+
+/* Thread function that tops up the thread page cache from the
+   page allocator each time the cache runs low, so that
+   thread_create() rarely has to call the allocator itself. */
+static void
+page_cache_refiller (void *aux UNUSED)
+{
+  for (;;)
+    {
+      sema_down (&page_cache_refill);
+      for (;;)
+        {
+          enum intr_level old_level;
+          void *page;
+          bool full;
+
+          old_level = intr_disable ();
+          full = page_cache_cnt >= PAGE_CACHE_MAX;
+          intr_set_level (old_level);
+          if (full)
+            break;
+
+          page = palloc_get_page (0);
+          if (page == NULL)
+            break;
+
+          old_level = intr_disable ();
+          if (page_cache_cnt < PAGE_CACHE_MAX)
+            {
+              page_cache[page_cache_cnt++] = page;
+              page = NULL;
+            }
+          intr_set_level (old_level);
+          if (page != NULL)
+            palloc_free_page (page);
+        }
+      page_cache_refill_pending = false;
     }
 }
 
@@ -561,9 +1280,17 @@ thread_schedule_tail (struct thread *prev)
    has completed. */
 static void
 schedule (void)
+{
+  schedule_to (next_thread_to_run ());
+}
+
+/* Switches from the running thread to NEXT, which must already
+   have been taken off the run queue.  Same preconditions as
+   schedule(). */
+static void
+schedule_to (struct thread *next)
 {
   struct thread *cur = running_thread ();
-  struct thread *next = next_thread_to_run ();
   struct thread *prev = NULL;
 
   ASSERT (intr_get_level () == INTR_OFF);
@@ -571,21 +1298,94 @@ schedule (void)
   ASSERT (is_thread (next));
 
   if (cur != next)
-    prev = switch_threads (cur, next);
+    {
+      TRACE (SWITCH, cur->tid, next->tid);
+      stats_switch (cur, next);
+      prev = switch_threads (cur, next);
+    }
+  else
+    preempting = false;
   thread_schedule_tail (prev);
 }
 
-/* Returns a tid to use for a new thread. */
+/* Updates scheduling statistics for a switch from CUR, which has
+   already left the running state, to NEXT.  Interrupts must be
+   off. */
+static void
+stats_switch (struct thread *cur, struct thread *next)
+{
+  int64_t now = timer_ticks ();
+
+  cur->stats.run_ticks += now - cur->stats.since;
+  cur->stats.since = now;
+  if (cur->status == THREAD_READY && preempting)
+    cur->stats.involuntary_switches++;
+  else
+    cur->stats.voluntary_switches++;
+  preempting = false;
+
+  if (next != idle_thread)
+    {
+      int64_t latency = now - next->stats.since;
+      int bucket = 0;
+
+      while (bucket < LATENCY_BUCKETS - 1 && latency >> bucket != 0)
+        bucket++;
+      next->stats.latency[bucket]++;
+      latency_hist[bucket]++;
+      next->stats.ready_ticks += latency;
+      if (latency > next->stats.max_latency)
+        next->stats.max_latency = latency;
+    }
+  next->stats.since = now;
+}
+
+/* Prints latency histogram HIST, one count per bucket, ending the
+   line. */
+static void
+print_latency_hist (const unsigned hist[LATENCY_BUCKETS])
+{
+  int b;
+
+  printf (" 0:%u", hist[0]);
+  for (b = 1; b < LATENCY_BUCKETS - 1; b++)
+    printf (" %d-%d:%u", 1 << (b - 1), (1 << b) - 1, hist[b]);
+  printf (" %d+:%u\n", 1 << (LATENCY_BUCKETS - 2), hist[b]);
+}
+
+/* Prints T's scheduling statistics.  Time in T's current state
+   is included. */
+static void
+print_thread_stats (struct thread *t, void *aux UNUSED)
+{
+  const struct thread_sched_stats *st = &t->stats;
+  int64_t current = timer_ticks () - st->since;
+
+  printf ("Thread %d (%s): %lld run, %lld ready, %lld blocked ticks, "
+          "%lld max latency, %u voluntary, %u involuntary switches\n",
+          t->tid, t->name,
+          st->run_ticks + (t->status == THREAD_RUNNING ? current : 0),
+          st->ready_ticks + (t->status == THREAD_READY ? current : 0),
+          st->blocked_ticks + (t->status == THREAD_BLOCKED ? current : 0),
+          st->max_latency, st->voluntary_switches,
+          st->involuntary_switches);
+  if (t != idle_thread)
+    {
+      printf ("  latency:");
+      print_latency_hist (st->latency);
+    }
+}
+
+/* Returns a tid to use for a new thread.  An atomic fetch-and-add
+   does the job without taking a lock. */
 static tid_t
 allocate_tid (void)
 {
   static tid_t next_tid = 1;
-  tid_t tid;
-
-  lock_acquire (&tid_lock);
-  tid = next_tid++;
-  lock_release (&tid_lock);
+  tid_t tid = 1;
 
+  asm volatile ("lock xaddl %0, %1"
+                : "+r" (tid), "+m" (next_tid) : : "memory");
   return tid;
 }
 
@@ -3,8 +3,10 @@
 
 #include <debug.h>
 #include <list.h>
+#include <rbtree.h>
 #include <stdint.h>
 #include "../lib/kernel/hash.h"
+#include "threads/fixed-point.h"
 /* States in a thread's life cycle. */
 enum thread_status
 {
@@ -24,6 +26,30 @@ typedef int tid_t;
 #define PRI_DEFAULT 31 /* Default priority. */
 #define PRI_MAX 63     /* Highest priority. */
 
+/* Thread nice values, for the multi-level feedback queue
+   scheduler. */
+#define NICE_MIN -20    /* Nicest to other threads. */
+#define NICE_DEFAULT 0  /* Default nice value. */
+#define NICE_MAX 20     /* Least nice to other threads. */
+
+/* Number of buckets in a scheduler latency histogram.  Bucket 0
+   counts waits of 0 ticks, bucket B > 0 waits of 2**(B-1) to
+   2**B - 1 ticks, and the last bucket everything longer. */
+#define LATENCY_BUCKETS 8
+
+/* Per-thread scheduling statistics, maintained by thread.c. */
+struct thread_sched_stats
+{
+  int64_t since;                 /* Tick of the last state change. */
+  int64_t run_ticks;             /* Ticks spent running. */
+  int64_t ready_ticks;           /* Ticks spent ready, not running. */
+  int64_t blocked_ticks;         /* Ticks spent blocked. */
+  int64_t max_latency;           /* Longest single wait while ready. */
+  unsigned voluntary_switches;   /* Switches out by blocking or yielding. */
+  unsigned involuntary_switches; /* Switches out by preemption. */
+  unsigned latency[LATENCY_BUCKETS]; /* Histogram of ready waits. */
+};
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -74,12 +100,20 @@ typedef int tid_t;
    the `magic' member of the running thread's `struct thread' is
    set to THREAD_MAGIC.  Stack overflow will normally change this
    value, triggering the assertion. */
-/* The `elem' member has a dual purpose.  It can be an element in
-   the run queue (thread.c), or it can be an element in a
-   semaphore wait list (synch.c).  It can be used these two ways
-   only because they are mutually exclusive: only a thread in the
-   ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+/* The `elem' member has a triple purpose.  It can be an element
+   in the run queue (thread.c), an element in a semaphore wait
+   list (synch.c), or an element in the sleep list (timer.c).  It
+   can be used these ways only because they are mutually
+   exclusive: only a thread in the ready state is on the run
+   queue, whereas only a blocked thread is on a semaphore wait
+   list or the sleep list, and a sleeping thread is not waiting
+   on a semaphore.  Under the fair scheduler the run queue is a
+   tree, which holds ready threads by `vruntime_elem' instead.
+
+   A semaphore wait list is kept in descending priority order.
+   While a blocked thread is on one, `wait_queue' points to it,
+   so that a change in the thread's priority can move it to its
+   new place. */
 struct thread
 {
   /* Owned by thread.c. */
@@ -87,28 +121,34 @@ struct thread
   enum thread_status status; /* Thread state. */
   char name[16];             /* Name (for debugging purposes). */
   uint8_t *stack;            /* Saved stack pointer. */
-  int priority;              /* Priority. */
+  int priority;              /* Effective priority, with donations. */
+  int base_priority;         /* Priority before donations. */
+  int nice;                  /* Nice value (mlfqs only). */
+  fixed_point recent_cpu;    /* Recent CPU time used (mlfqs only). */
+  int64_t vruntime;          /* Weighted CPU time used (cfs only). */
+  struct rb_elem vruntime_elem; /* Run queue element (cfs only). */
   struct list_elem allelem;  /* List element for all threads list. */
+  struct thread_sched_stats stats; /* Scheduling statistics. */
 
   /* Shared between thread.c and synch.c. */
-  struct list_elem elem; /* List element. */
+  struct list_elem elem;  /* List element. */
+  struct list held_locks; /* Locks held, for priority donation. */
+  struct lock *wait_lock; /* Lock being waited for, if any. */
+  struct list *wait_queue; /* Priority-ordered list ELEM is on. */
+
+  /* Owned by devices/timer.c. */
+  int64_t wakeup_tick; /* Tick to wake up at, while sleeping. */
 
-  struct thread *parent_thread;
 #ifdef USERPROG
   /* Owned by userprog/process.c. */
   uint32_t *pagedir; /* Page directory. */
-  struct sema_t *child_sema;
-  struct sema_t *wait_sema;
   struct list file_table;
   struct file *file;
 
   //Child
-  tid_t child_tid;
-  struct sema_t *parent_sema;
-  struct thread *child_thread;
   int exit_status;
-  struct list_elem child_elem;
-  int child_exit_status;
+  struct list children;       /* Records of this process's children. */
+  struct child *child_record; /* Own record in the parent, if any. */
   struct hash spt;
   uint32_t *esp;
 
@@ -124,6 +164,10 @@ struct thread
    Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
 
+/* If true, use the completely fair scheduler.
+   Controlled by kernel command-line option "-cfs". */
+extern bool thread_cfs;
+
 void thread_init(void);
 void thread_start(void);
 
@@ -135,6 +179,7 @@ tid_t thread_create(const char *name, int priority, thread_func *, void *);
 
 void thread_block(void);
 void thread_unblock(struct thread *);
+void thread_handoff(struct thread *);
 
 struct thread *thread_current(void);
 tid_t thread_tid(void);
@@ -142,6 +187,7 @@ const char *thread_name(void);
 
 void thread_exit(void) NO_RETURN;
 void thread_yield(void);
+void thread_preempt(void);
 
 /* Performs some operation on thread t, given auxiliary data AUX. */
 typedef void thread_action_func(struct thread *t, void *aux);
@@ -149,6 +195,10 @@ void thread_foreach(thread_action_func *, void *);
 
 int thread_get_priority(void);
 void thread_set_priority(int);
+void thread_donate_priority(struct thread *, int);
+void thread_refresh_priority(struct thread *);
+bool thread_priority_greater(const struct list_elem *,
+                             const struct list_elem *, void *aux);
 
 int thread_get_nice(void);
 void thread_set_nice(int);
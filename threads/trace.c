@@ -0,0 +1,124 @@
+#include "threads/trace.h"
+
+#if TRACE_EVENTS
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* One trace record.  Its layout is what utils/pintos-trace
+   decodes, so keep the two in sync. */
+struct trace_rec
+  {
+    uint64_t tsc;               /* Time-stamp counter. */
+    uint16_t event;             /* A trace_event. */
+    uint16_t size;              /* sizeof (struct trace_rec). */
+    int32_t tid;                /* Running thread. */
+    uint32_t a, b;              /* Event arguments. */
+    uint32_t reserved[2];       /* Pads the record to 32 bytes. */
+  };
+
+/* Pages in the ring buffer. */
+#define TRACE_PAGES 16
+
+/* Number of records in the ring buffer, a power of 2. */
+#define TRACE_REC_CNT (TRACE_PAGES * PGSIZE / sizeof (struct trace_rec))
+
+/* Ring buffer.  Writers claim a slot by atomically incrementing
+   TRACE_HEAD, so a tracepoint hit in an interrupt handler while
+   another is half written just takes the next slot.  Once the
+   buffer is full, the oldest records are overwritten. */
+static struct trace_rec *trace_buf;
+static uint32_t trace_head;     /* # of records ever claimed. */
+
+/* TSC and timer ticks at trace_init(), for the decoder to
+   convert timestamps to time. */
+static uint64_t start_tsc;
+static int64_t start_ticks;
+
+static inline uint64_t rdtsc (void);
+
+/* Allocates the ring buffer.  Must be called after the page
+   allocator is initialized.  Tracepoints hit earlier are
+   dropped. */
+void
+trace_init (void)
+{
+  ASSERT ((TRACE_REC_CNT & (TRACE_REC_CNT - 1)) == 0);
+  ASSERT (TRACE_SYSCALL + 1 == TRACE_EVENT_CNT);
+
+  start_ticks = timer_ticks ();
+  start_tsc = rdtsc ();
+  trace_buf = palloc_get_multiple (PAL_ZERO, TRACE_PAGES);
+  if (trace_buf == NULL)
+    printf ("trace: cannot allocate ring buffer, tracing disabled\n");
+}
+
+/* Appends a record of EVENT with arguments A and B.  May be
+   called from any context, including interrupt handlers. */
+void
+trace_record (enum trace_event event, uint32_t a, uint32_t b)
+{
+  struct trace_rec *r;
+  uint32_t slot = 1;
+  int dummy;
+
+  if (trace_buf == NULL)
+    return;
+
+  asm volatile ("lock xaddl %0, %1"
+                : "+r" (slot), "+m" (trace_head) : : "memory");
+  r = &trace_buf[slot & (TRACE_REC_CNT - 1)];
+  r->tsc = rdtsc ();
+  r->event = event;
+  r->size = sizeof *r;
+  /* The running thread's struct is at the bottom of our stack
+     page.  Not thread_current(), which asserts that the thread
+     is running, which is not the case inside schedule(). */
+  r->tid = ((struct thread *) pg_round_down (&dummy))->tid;
+  r->a = a;
+  r->b = b;
+  r->reserved[0] = r->reserved[1] = 0;
+}
+
+/* Prints the ring buffer, oldest record first, as a header line
+   followed by one "TR:" line per record holding the record's
+   bytes in hexadecimal. */
+void
+trace_dump (void)
+{
+  uint32_t head = trace_head;
+  uint32_t first = head > TRACE_REC_CNT ? head - TRACE_REC_CNT : 0;
+  int64_t ticks = timer_ticks () - start_ticks;
+  uint32_t i;
+
+  printf ("Trace: %"PRIu32" records, %"PRIu32" overwritten, "
+          "%"PRIu64" cycles in %"PRId64" ticks at %d Hz\n",
+          head - first, first, rdtsc () - start_tsc, ticks, TIMER_FREQ);
+  if (trace_buf == NULL)
+    return;
+  for (i = first; i != head; i++)
+    {
+      const struct trace_rec *r = &trace_buf[i & (TRACE_REC_CNT - 1)];
+      const uint8_t *p = (const uint8_t *) r;
+      size_t j;
+
+      printf ("TR: ");
+      for (j = 0; j < sizeof (struct trace_rec); j++)
+        printf ("%02x", p[j]);
+      printf ("\n");
+    }
+}
+
+/* Returns the CPU's time-stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+#endif /* TRACE_EVENTS */
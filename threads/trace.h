@@ -0,0 +1,63 @@
+#ifndef THREADS_TRACE_H
+#define THREADS_TRACE_H
+
+#include <stdint.h>
+
+/* Static tracepoints.
+
+   TRACE (EVENT, A, B) records EVENT with two 32-bit arguments,
+   the running thread's tid and a TSC timestamp as a fixed-size
+   binary record in a ring buffer, without taking any lock.  The
+   "trace-dump" kernel action prints the buffer, and
+   utils/pintos-trace decodes the output into a timeline.
+
+   Tracepoints are selected at compile time: bit TRACE_x of
+   TRACE_EVENTS enables the TRACE (x, ...) sites.  A disabled
+   site compiles to nothing.  By default all are disabled.
+
+   TRACE_EVENTS is tested with #if, so it must be built from
+   numbers and macros only, not from the enum below.  Build with
+   -DTRACE_EVENTS=TRACE_ALL to enable every tracepoint, or with a
+   mask of event numbers, such as -DTRACE_EVENTS=0x30 for
+   evictions and swap-outs. */
+
+/* Number of traced events, and a mask of all of them. */
+#define TRACE_EVENT_CNT 10
+#define TRACE_ALL ((1u << TRACE_EVENT_CNT) - 1)
+
+#ifndef TRACE_EVENTS
+#define TRACE_EVENTS 0
+#endif
+
+/* Traced events.  utils/pintos-trace knows these by number, so
+   add new ones only at the end, and update TRACE_EVENT_CNT. */
+enum trace_event
+  {
+    TRACE_SWITCH,               /* Context switch: prev tid, next tid. */
+    TRACE_BLOCK,                /* Thread blocks: caller address. */
+    TRACE_UNBLOCK,              /* Thread unblocked: its tid. */
+    TRACE_PAGE_FAULT,           /* Page fault: address, eip. */
+    TRACE_EVICT,                /* Frame evicted: user page, frame. */
+    TRACE_SWAP_OUT,             /* Page swapped out: frame, slot. */
+    TRACE_SWAP_IN,              /* Page swapped in: frame, slot. */
+    TRACE_BLOCK_READ,           /* Sector read: block type, sector. */
+    TRACE_BLOCK_WRITE,          /* Sector written: block type, sector. */
+    TRACE_SYSCALL,              /* System call: number. */
+  };
+
+#if TRACE_EVENTS
+void trace_init (void);
+void trace_record (enum trace_event, uint32_t a, uint32_t b);
+void trace_dump (void);
+
+#define TRACE(EVENT, A, B)                                              \
+        do {                                                            \
+          if (TRACE_EVENTS & (1u << TRACE_##EVENT))                     \
+            trace_record (TRACE_##EVENT, (uint32_t) (A), (uint32_t) (B)); \
+        } while (0)
+#else
+#define trace_init() ((void) 0)
+#define TRACE(EVENT, A, B) ((void) 0)
+#endif
+
+#endif /* threads/trace.h */
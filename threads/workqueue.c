@@ -0,0 +1,139 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Number of worker threads per queue. */
+#define WORKERS_PER_QUEUE 2
+
+/* A queue of pending work and the workers that serve it. */
+struct queue
+  {
+    const char *name;           /* Name, for worker threads. */
+    int priority;               /* Priority of worker threads. */
+    struct list pending;        /* Queued struct work's. */
+    struct semaphore items;     /* Count of items in PENDING. */
+    unsigned long long done;    /* # of items completed. */
+  };
+
+/* The queues.  PENDING is accessed only with interrupts off,
+   because work_queue() may be called from an interrupt
+   handler.  Work may be queued before the workers exist, for
+   example by an early keyboard interrupt; it runs once they
+   start. */
+static struct queue queues[WORK_QUEUE_CNT] =
+  {
+    [WORK_HIGH] = { "work-high", PRI_DEFAULT + 10,
+                    LIST_INITIALIZER (queues[WORK_HIGH].pending) },
+    [WORK_NORMAL] = { "work", PRI_DEFAULT,
+                      LIST_INITIALIZER (queues[WORK_NORMAL].pending) },
+  };
+
+/* True once workqueue_init() has initialized ITEMS. */
+static bool started;
+
+static thread_func worker;
+
+/* Initializes the queues and starts their worker threads.  Must
+   be called after thread_start(). */
+void
+workqueue_init (void)
+{
+  enum intr_level old_level;
+  int i, j;
+
+  old_level = intr_disable ();
+  for (i = 0; i < WORK_QUEUE_CNT; i++)
+    sema_init (&queues[i].items, list_size (&queues[i].pending));
+  started = true;
+  intr_set_level (old_level);
+
+  for (i = 0; i < WORK_QUEUE_CNT; i++)
+    {
+      struct queue *q = &queues[i];
+
+      for (j = 0; j < WORKERS_PER_QUEUE; j++)
+        if (thread_create (q->name, q->priority, worker, q) == TID_ERROR)
+          PANIC ("%s: cannot create worker thread", q->name);
+    }
+}
+
+/* Initializes W to call FUNC with AUX when it is run. */
+void
+work_init (struct work *w, work_func *func, void *aux)
+{
+  ASSERT (w != NULL);
+  ASSERT (func != NULL);
+
+  w->func = func;
+  w->aux = aux;
+  w->pending = false;
+}
+
+/* Queues W on queue Q, unless it is already pending.  Returns
+   true if W was queued, false if it was already pending.
+
+   This function may be called from an interrupt handler. */
+bool
+work_queue (enum work_queue q, struct work *w)
+{
+  enum intr_level old_level;
+  bool queued;
+
+  ASSERT (q < WORK_QUEUE_CNT);
+  ASSERT (w != NULL);
+
+  old_level = intr_disable ();
+  queued = !w->pending;
+  if (queued)
+    {
+      w->pending = true;
+      list_push_back (&queues[q].pending, &w->elem);
+      if (started)
+        sema_up (&queues[q].items);
+    }
+  intr_set_level (old_level);
+
+  return queued;
+}
+
+/* Prints the number of items each queue has completed. */
+void
+workqueue_print_stats (void)
+{
+  int i;
+
+  printf ("Workqueue:");
+  for (i = 0; i < WORK_QUEUE_CNT; i++)
+    printf (" %s %llu", queues[i].name, queues[i].done);
+  printf (" items done\n");
+}
+
+/* Worker thread.  Runs the items queued on the struct queue
+   passed as Q_, in order, forever. */
+static void
+worker (void *q_)
+{
+  struct queue *q = q_;
+
+  for (;;)
+    {
+      enum intr_level old_level;
+      struct work *w;
+
+      sema_down (&q->items);
+
+      old_level = intr_disable ();
+      w = list_entry (list_pop_front (&q->pending), struct work, elem);
+      w->pending = false;
+      intr_set_level (old_level);
+
+      w->func (w->aux);
+
+      old_level = intr_disable ();
+      q->done++;
+      intr_set_level (old_level);
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+
+/* Deferred work.
+
+   An interrupt handler runs with interrupts off, so everything
+   it does adds to interrupt latency.  A handler that has more to
+   do than acknowledge the hardware can instead queue a struct
+   work, whose function is then called later by a kernel worker
+   thread, with interrupts on and under the normal scheduler.
+
+   Work items are allocated by the caller, typically statically
+   or inside the device's own state, so that queuing never needs
+   to allocate memory.  An item may be queued again once its
+   function has started running. */
+
+/* Function called to do deferred work, given auxiliary data
+   AUX. */
+typedef void work_func (void *aux);
+
+/* Queues, in descending order of the priority of the worker
+   threads that serve them. */
+enum work_queue
+  {
+    WORK_HIGH,                  /* I/O completion and the like. */
+    WORK_NORMAL,                /* Everything else. */
+    WORK_QUEUE_CNT
+  };
+
+/* A unit of deferred work. */
+struct work
+  {
+    struct list_elem elem;      /* Element in a queue. */
+    work_func *func;            /* Function to call. */
+    void *aux;                  /* Argument to FUNC. */
+    bool pending;               /* Queued but not yet started? */
+  };
+
+void workqueue_init (void);
+void work_init (struct work *, work_func *, void *aux);
+bool work_queue (enum work_queue, struct work *);
+void workqueue_print_stats (void);
+
+#endif /* threads/workqueue.h */
@@ -15,7 +15,9 @@
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 #include "vm/frame.h"
+#include "vm/share.h"
 #include "vm/swap.h"
 
 /* Number of page faults processed. */
@@ -159,6 +161,7 @@ page_fault (struct intr_frame *f)
 
   /* Count page faults. */
   page_fault_cnt++;
+  TRACE (PAGE_FAULT, fault_addr, f->eip);
 
   /* Determine cause. */
   not_present = (f->error_code & PF_P) == 0;
@@ -169,13 +172,52 @@ page_fault (struct intr_frame *f)
   /////////////////////////////////////////////////////////////////////////////////////////////////
   if (is_user_vaddr(fault_addr)){
     struct data *d = spt_get(&thread_current() -> spt, (fault_addr));
+    if (d != NULL && !not_present && write && d ->writable
+        && d ->swapIndex != NO_SWAP_SLOT){
+      /* First write to a page that still matches its swap slot. */
+      frame_make_writable(d);
+      return;
+    }
+    if (d != NULL && !not_present){
+      /* Write to a read-only page. */
+      test = 6;
+      goto error;
+    }
+    if (d != NULL && d ->file != NULL && !d ->writable && !d ->mapped){
+      /* Read-only pages of an executable are shared by every
+         process running it. */
+      uint8_t *kpage = share_map(d);
+      if (kpage == NULL){
+        test = 4;
+        goto error;
+      }
+      if (!install_page(d -> upage, kpage, false)){
+        test = 3;
+        share_unmap(d);
+        goto error;
+      }
+      d ->kpage = kpage;
+      d ->loaded = true;
+      return;
+    }
     if (d != NULL){
       uint8_t *kpage = get_frame(PAL_USER, d);
+      if (kpage == NULL){
+        test = 4;
+        goto error;
+      }
       d ->kpage = kpage;
       if(d ->inSwap){
         swaptmem(kpage, d -> swapIndex);
-        d ->loaded = true;
         d ->inSwap = false;
+        /* Map it read-only while it matches its swap slot, so that
+           the first write faults and releases the slot. */
+        if (!install_page(d -> upage, kpage, false)){
+          test = 3;
+          frame_free(kpage);
+          goto error;
+        }
+        d ->loaded = true;
         return;
       }
       if(d -> loaded){
@@ -0,0 +1,196 @@
+#include "userprog/futex.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+
+/* Fast user-space mutexes.
+
+   A user program blocks with futex_wait() on a 32-bit word in
+   memory and is woken by futex_wake() on the same word.  Waiters
+   are kept in a hash table keyed by the word's kernel virtual
+   address, which identifies the physical frame and the offset
+   within it.  Two processes that map the same frame, such as a
+   shared page of an executable they both run, therefore meet in
+   the same hash chain, wherever the frame is mapped in each.
+
+   The key is only stable while the word stays in its frame, so a
+   frame with a waiter is pinned: the eviction code asks
+   futex_pinned() and passes over it.
+
+   The table has a fixed number of chains and each waiter's record
+   lives on its own kernel stack, so nothing is allocated.  The
+   table is only touched with interrupts off, which also makes
+   checking the word and going to sleep atomic with respect to
+   futex_wake() and to eviction. */
+
+/* Number of hash chains. */
+#define FUTEX_BUCKETS 64
+
+/* A thread blocked in futex_wait(). */
+struct futex_waiter
+  {
+    struct list_elem elem;      /* Element in a hash chain. */
+    const int *key;             /* Kernel address of the word. */
+    struct thread *thread;      /* The waiting thread. */
+  };
+
+static struct list futex_buckets[FUTEX_BUCKETS];
+
+/* Total number of blocked waiters, so that a wake with nobody
+   waiting returns without translating the address or hashing. */
+static unsigned futex_waiter_cnt;
+
+static bool valid_uaddr (const int *uaddr);
+static const int *translate (const int *uaddr);
+static struct list *bucket (const void *kaddr);
+
+/* Initializes the futex table. */
+void
+futex_init (void)
+{
+  size_t i;
+
+  for (i = 0; i < FUTEX_BUCKETS; i++)
+    list_init (&futex_buckets[i]);
+  futex_waiter_cnt = 0;
+}
+
+/* If the word at user address UADDR still holds EXPECTED, blocks
+   until another thread calls futex_wake() on the same word and
+   returns 0.  Otherwise returns -1 at once.  Also returns -1 if
+   UADDR is not word-aligned. */
+int
+futex_wait (int *uaddr, int expected)
+{
+  struct futex_waiter w;
+  enum intr_level old_level;
+  int result = 0;
+
+  if (!valid_uaddr (uaddr))
+    return -1;
+
+  old_level = intr_disable ();
+  w.key = translate (uaddr);
+  if (*w.key != expected)
+    result = -1;
+  else
+    {
+      w.thread = thread_current ();
+      list_push_back (bucket (w.key), &w.elem);
+      futex_waiter_cnt++;
+      thread_block ();
+    }
+  intr_set_level (old_level);
+
+  return result;
+}
+
+/* Wakes up to N threads waiting on the word at user address
+   UADDR, oldest first, and returns the number woken. */
+int
+futex_wake (int *uaddr, int n)
+{
+  enum intr_level old_level;
+  const int *key;
+  struct list *chain;
+  struct list_elem *e;
+  int woken = 0;
+
+  if (futex_waiter_cnt == 0 || n <= 0 || !valid_uaddr (uaddr))
+    return 0;
+
+  old_level = intr_disable ();
+  key = translate (uaddr);
+  chain = bucket (key);
+  e = list_begin (chain);
+  while (woken < n && e != list_end (chain))
+    {
+      struct futex_waiter *w = list_entry (e, struct futex_waiter, elem);
+      e = list_next (e);
+      if (w->key == key)
+        {
+          list_remove (&w->elem);
+          futex_waiter_cnt--;
+          thread_unblock (w->thread);
+          woken++;
+        }
+    }
+  intr_set_level (old_level);
+
+  if (woken > 0)
+    thread_preempt ();
+  return woken;
+}
+
+/* Returns true if a thread is waiting on a word in the frame at
+   kernel address FRAME, which must then stay where it is. */
+bool
+futex_pinned (const void *frame)
+{
+  enum intr_level old_level;
+  struct list *chain;
+  struct list_elem *e;
+  bool pinned = false;
+
+  if (futex_waiter_cnt == 0)
+    return false;
+
+  old_level = intr_disable ();
+  chain = bucket (frame);
+  for (e = list_begin (chain); e != list_end (chain); e = list_next (e))
+    {
+      struct futex_waiter *w = list_entry (e, struct futex_waiter, elem);
+      if (pg_round_down (w->key) == frame)
+        {
+          pinned = true;
+          break;
+        }
+    }
+  intr_set_level (old_level);
+
+  return pinned;
+}
+
+/* Returns true if UADDR is a word-aligned user address. */
+static bool
+valid_uaddr (const int *uaddr)
+{
+  return (uintptr_t) uaddr % sizeof *uaddr == 0 && is_user_vaddr (uaddr);
+}
+
+/* Returns the kernel address at which the running process sees
+   the word at user address UADDR.  If the page is not present,
+   for instance because it was evicted after the system call
+   checked it, faults it back in first.  Interrupts must be off;
+   they are turned back on only while faulting. */
+static const int *
+translate (const int *uaddr)
+{
+  const int *kaddr;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while ((kaddr = pagedir_get_page (thread_current ()->pagedir,
+                                    uaddr)) == NULL)
+    {
+      intr_enable ();
+      *(volatile const int *) uaddr;
+      intr_disable ();
+    }
+  return kaddr;
+}
+
+/* Returns the hash chain for the word at kernel address KADDR.
+   All the words of a frame share a chain, so that
+   futex_pinned() need look at only one. */
+static struct list *
+bucket (const void *kaddr)
+{
+  return &futex_buckets[hash_int (pg_no (kaddr)) % FUTEX_BUCKETS];
+}
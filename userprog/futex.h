@@ -0,0 +1,11 @@
+#ifndef USERPROG_FUTEX_H
+#define USERPROG_FUTEX_H
+
+#include <stdbool.h>
+
+void futex_init (void);
+int futex_wait (int *uaddr, int expected);
+int futex_wake (int *uaddr, int n);
+bool futex_pinned (const void *frame);
+
+#endif /* userprog/futex.h */
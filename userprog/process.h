@@ -13,6 +13,7 @@ typedef int pid_t;
 //    struct dir *dir;
 // };
 
+void process_init (void);
 tid_t process_execute (const char *file_name);
 int process_wait (tid_t);
 void process_exit (void);
@@ -4,11 +4,13 @@
 #include <stdbool.h>
 #include "userprog/syscall.h"
 #include "userprog/process.h"
+#include "userprog/futex.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "threads/synch.h"
 #include "threads/palloc.h"
+#include "threads/trace.h"
 #include "filesys/filesys.h"
 #include "filesys/file.h"
 #include "filesys/directory.h"
@@ -30,6 +32,8 @@ static int sys_write(int fd, const void *buffer, unsigned size);
 static void sys_seek(int fd, unsigned position);
 static unsigned sys_tell(int fd);
 static void sys_close(int fd);
+static int sys_futex_wait(int *addr, int expected);
+static int sys_futex_wake(int *addr, int n);
 
 static void invalid_access(void);
 static void read_user_mem(void *dest, void *uaddr, size_t size);
@@ -39,7 +43,10 @@ static bool put_user(uint8_t *udst, uint8_t byte);
 static struct file_table_entry *get_file_table_entry(int fd);
 static void check_init_list(struct list* list);
 
-static struct lock lock;
+/* Serializes file system access.  Calls that only read file
+   system state (read, filesize, seek, tell) share it; calls that
+   change it take it exclusively.  Console I/O does not need it. */
+static struct rwlock fs_lock;
 
 struct file_table_entry{
   int fd;
@@ -50,12 +57,15 @@ struct file_table_entry{
 void syscall_init(void){
   intr_register_int(0x30, 3, INTR_ON, syscall_handler, "syscall");
 
-  lock_init(&lock);
+  rwlock_init(&fs_lock);
+  rwlock_set_name(&fs_lock, "file system");
+  futex_init();
 }
 
 static void syscall_handler(struct intr_frame *f UNUSED){
   uint32_t syscall_num;
   read_user_mem(&syscall_num, f->esp, sizeof(syscall_num));
+  TRACE (SYSCALL, syscall_num, 0);
   thread_current() -> esp = &f->esp;
   switch (syscall_num){
     /* Halt the operating system. */
@@ -163,6 +173,24 @@ static void syscall_handler(struct intr_frame *f UNUSED){
       sys_close(fd);
       break;
     }
+    /* Wait on a word in user memory. */
+    case SYS_FUTEX_WAIT:{
+      int *addr;
+      int expected;
+      read_user_mem(&addr, f->esp + 4, sizeof(addr));
+      read_user_mem(&expected, f->esp + 8, sizeof(expected));
+      f->eax = sys_futex_wait(addr, expected);
+      break;
+    }
+    /* Wake threads waiting on a word in user memory. */
+    case SYS_FUTEX_WAKE:{
+      int *addr;
+      int n;
+      read_user_mem(&addr, f->esp + 4, sizeof(addr));
+      read_user_mem(&n, f->esp + 8, sizeof(n));
+      f->eax = sys_futex_wake(addr, n);
+      break;
+    }
     default:{
       thread_current()->exit_status = -1;
       thread_exit();
@@ -210,9 +238,9 @@ void sys_exit(int status){
  * appropriate synchronization to ensure this. 
  */
 tid_t sys_exec(const char *cmd_line){
-  lock_acquire(&lock);
+  rwlock_write_acquire(&fs_lock);
   tid_t pid = process_execute(cmd_line);
-  lock_release(&lock);
+  rwlock_write_release(&fs_lock);
   return pid;
 }
 
@@ -234,9 +262,9 @@ bool sys_create(const char *name, unsigned initial_size){
   if(name == NULL){
     sys_exit(-1);
   }
-  lock_acquire(&lock);
+  rwlock_write_acquire(&fs_lock);
   bool success = filesys_create(name, initial_size);
-  lock_release(&lock);
+  rwlock_write_release(&fs_lock);
   return success;
 }
 
@@ -247,9 +275,9 @@ bool sys_create(const char *name, unsigned initial_size){
  * an Open File, for details. 
  */
 bool sys_remove(const char *name){
-  lock_acquire(&lock);
+  rwlock_write_acquire(&fs_lock);
   bool success = filesys_remove(name);
-  lock_release(&lock);
+  rwlock_write_release(&fs_lock);
   return success;
 }
 
@@ -271,15 +299,15 @@ int sys_open(const char *name){
     return -1;
   }
 
-  lock_acquire(&lock);
+  rwlock_write_acquire(&fs_lock);
   struct file *file = filesys_open(name);
   if (file == NULL){
-    lock_release(&lock);
+    rwlock_write_release(&fs_lock);
     palloc_free_page(fte);
     return -1;
   }
   fte->file = file;
-  lock_release(&lock);
+  rwlock_write_release(&fs_lock);
 
   // Add entry to current thread's file table
   struct thread *curr = thread_current();
@@ -303,14 +331,14 @@ int sys_open(const char *name){
 int sys_filesize(int fd){
   int size;
 
-  lock_acquire(&lock);
+  rwlock_read_acquire(&fs_lock);
   struct file_table_entry *fte = get_file_table_entry(fd);
   if (fte == NULL){
-    lock_release(&lock);
+    rwlock_read_release(&fs_lock);
     return -1;
   }
   size = file_length(fte->file);
-  lock_release(&lock);
+  rwlock_read_release(&fs_lock);
 
   return size;
 }
@@ -331,13 +359,11 @@ int sys_read(int fd, void *buffer, unsigned size){
     } 
   }
 
-  lock_acquire(&lock);
   // reads from keyboard
   if (fd == 0){
     for (unsigned i = 0; i < size; i++){
       success = put_user(buffer, input_getc());
       if (!success){
-        lock_release(&lock);
         invalid_access();
       }
     }
@@ -346,13 +372,13 @@ int sys_read(int fd, void *buffer, unsigned size){
   } else{
     struct file_table_entry *fte = get_file_table_entry(fd);
     if (fte == NULL){
-      lock_release(&lock);
       return -1;
     }
+    rwlock_read_acquire(&fs_lock);
     read = file_read(fte->file, buffer, size);
+    rwlock_read_release(&fs_lock);
   }
 
-  lock_release(&lock);
   return read;
 }
 
@@ -370,25 +396,23 @@ int sys_write(int fd, const void *buffer, unsigned size){
     } 
   }
 
-  lock_acquire(&lock);
   // writes to console
   if (fd == 1){
     putbuf(buffer, size);
-    lock_release(&lock);
     return size;
 
     // write to file
   } else{
     struct file_table_entry *fte = get_file_table_entry(fd);
     if (fte == NULL || fte->file == NULL){
-      lock_release(&lock);
       return -1;
     }
 
+    rwlock_write_acquire(&fs_lock);
     written = file_write(fte->file, buffer, size);
+    rwlock_write_release(&fs_lock);
   }
 
-  lock_release(&lock);
   return written;
 }
 
@@ -398,16 +422,16 @@ int sys_write(int fd, const void *buffer, unsigned size){
  * 0 is the file's start.) 
  */
 void sys_seek(int fd, unsigned position){
-  lock_acquire(&lock);
+  rwlock_read_acquire(&fs_lock);
 
   struct file_table_entry *fte = get_file_table_entry(fd);
   if (fte == NULL){
-    lock_release(&lock);
+    rwlock_read_release(&fs_lock);
     return;
   }
 
   file_seek(fte->file, position);
-  lock_release(&lock);
+  rwlock_read_release(&fs_lock);
 }
 
 /**
@@ -417,15 +441,15 @@ void sys_seek(int fd, unsigned position){
 unsigned sys_tell(int fd){
   unsigned pos;
 
-  lock_acquire(&lock);
+  rwlock_read_acquire(&fs_lock);
   struct file_table_entry *fte = get_file_table_entry(fd);
   if (fte == NULL){
-    lock_release(&lock);
+    rwlock_read_release(&fs_lock);
     return -1;
   }
 
   pos = file_tell(fte->file);
-  lock_release(&lock);
+  rwlock_read_release(&fs_lock);
   return pos;
 }
 
@@ -434,17 +458,42 @@ unsigned sys_tell(int fd){
  * all its open file descriptors, as if by calling this function for each one. 
  */
 void sys_close(int fd){
-  lock_acquire(&lock);
+  rwlock_write_acquire(&fs_lock);
   struct file_table_entry *fte = get_file_table_entry(fd);
   if (fte == NULL || fte->file == NULL){
-    lock_release(&lock);
+    rwlock_write_release(&fs_lock);
     return;
   }
 
   file_close(fte->file);
   list_remove(&fte->elem);
   palloc_free_page(fte);
-  lock_release(&lock);
+  rwlock_write_release(&fs_lock);
+}
+
+/**
+ * If the word at addr still holds expected, blocks until another thread 
+ * calls futex_wake on the same word and returns 0. Otherwise returns -1 
+ * without blocking. Lets user programs build locks that only enter the 
+ * kernel when they have to wait. 
+ */
+int sys_futex_wait(int *addr, int expected){
+  int value;
+
+  // fault the page in, and kill the process on a bad pointer
+  read_user_mem(&value, addr, sizeof(value));
+  return futex_wait(addr, expected);
+}
+
+/**
+ * Wakes up to n threads waiting on the word at addr. Returns the number 
+ * of threads woken. 
+ */
+int sys_futex_wake(int *addr, int n){
+  int value;
+
+  read_user_mem(&value, addr, sizeof(value));
+  return futex_wake(addr, n);
 }
 
 //----------------------- Accessing User Memory Functions --------------------------//
@@ -455,8 +504,8 @@ void sys_close(int fd){
  * freeing its resources. 
  */
 static void invalid_access(){
-  if (lock_held_by_current_thread(&lock)){
-    lock_release(&lock);
+  if (rwlock_write_held_by_current_thread(&fs_lock)){
+    rwlock_write_release(&fs_lock);
   }
   sys_exit(-1);
 }
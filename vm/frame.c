@@ -1,34 +1,96 @@
 #include "swap.h"
 #include "frame.h"
+#include "devices/timer.h"
+#include "threads/malloc.h"
+#include "threads/trace.h"
+#include "userprog/futex.h"
 
+/* Under WSClock, a page seen accessed within this many timer
+   ticks is in its process's working set, and is evicted only if
+   no page outside every working set can be found. */
+#define WSCLOCK_AGE (TIMER_FREQ / 2)
+
+bool frame_wsclock;
 
 struct list ft;
 struct lock fl;
+
+/* Frames evicted to swap whose write has not finished yet, and a
+   condition signaled each time one finishes and is freed. */
+static int swap_outs;
+static struct condition swap_out_finished;
+
+/* Clock hand: the next frame table entry to consider for
+   eviction, or NULL to start over from the front. */
+static struct list_elem *hand;
+
+static bool evict(void);
+
 void frame_init(){
     list_init(&ft);
     lock_init(&fl);
+    cond_init(&swap_out_finished);
+    lock_set_name(&fl, "frame table");
 }
 
-void * get_frame(enum palloc_flags flags, struct data *d){
+/* Allocates a frame for page D, mapped in page directory PD, or
+   for no page if D is NULL. */
+static void * alloc_frame(enum palloc_flags flags, struct data *d, uint32_t *pd){
     lock_acquire(&fl);
-    struct fte *fe = malloc(sizeof(struct fte));
     void * frame = palloc_get_page(flags);
+    while(frame == NULL && (flags & PAL_USER)){
+        /* A page evicted to swap frees its frame only once it has
+           been written, so wait for one if eviction alone did not
+           free a frame. */
+        bool evicted = evict();
+        frame = palloc_get_page(flags);
+        if(frame == NULL && swap_outs > 0){
+            cond_wait(&swap_out_finished, &fl);
+            frame = palloc_get_page(flags);
+        }else if(frame == NULL && !evicted)
+            break;
+    }
     if(frame != NULL){
+        struct fte *fe = malloc(sizeof(struct fte));
+        if(fe == NULL){
+            palloc_free_page(frame);
+            lock_release(&fl);
+            return NULL;
+        }
         fe ->frame = frame;
         fe ->d = d;
+        fe ->pagedir = pd;
+        fe ->upage = d != NULL ? (void *) d -> upage : NULL;
+        fe ->last_used = timer_ticks();
         add_frame(fe);
-    }else{
-        evict(flags);
-        frame = palloc_get_page(flags);
     }
     lock_release(&fl);
     return frame;
 }
 
+void * get_frame(enum palloc_flags flags, struct data *d){
+    return alloc_frame(flags, d, thread_current() -> pagedir);
+}
+
+/* Returns a user frame that belongs to no process, for a page
+   that several processes map.  It is never evicted, and is freed
+   only by frame_free(). */
+void * get_shared_frame(void){
+    return alloc_frame(PAL_USER, NULL, NULL);
+}
+
 void add_frame(struct fte *e){
     list_push_back(&ft, &e->elem);
 }
 
+/* Removes E from the frame table, moving the clock hand off it
+   first.  Must be called with the frame table lock held. */
+static void remove_frame(struct fte *e){
+    if(hand == &e->elem)
+        hand = list_next(hand);
+    list_remove(&e->elem);
+}
+
 void frame_free(void *frame){
     lock_acquire(&fl);
     struct list_elem *le;
@@ -36,7 +98,7 @@ void frame_free(void *frame){
     for(le = list_begin(&ft); le != list_end(&ft); le = list_next(le)){
         e = list_entry(le, struct fte, elem);
         if(e ->frame == frame){
-            list_remove(e);
+            remove_frame(e);
             palloc_free_page(frame);
             free(e);
             break;
@@ -45,22 +107,202 @@ void frame_free(void *frame){
     lock_release(&fl);
 }
 
-void evict(){
+/* Drops the frames owned by page directory PD, which is about to
+   be destroyed.  pagedir_destroy() frees the frames still mapped
+   in PD; the others are freed here.  A frame with no user
+   address, such as the argument page setup_stack() uses, is
+   never mapped. */
+void frame_free_pagedir(uint32_t *pd){
+    lock_acquire(&fl);
     struct list_elem *le = list_begin(&ft);
+    while(le != list_end(&ft)){
+        struct fte *e = list_entry(le, struct fte, elem);
+        le = list_next(le);
+        if(e ->pagedir == pd){
+            if(e ->upage == NULL || pagedir_get_page(pd, e ->upage) != e ->frame)
+                palloc_free_page(e ->frame);
+            remove_frame(e);
+            free(e);
+        }
+    }
+    lock_release(&fl);
+}
+
+/* Makes the current process's page D, which was mapped read-only
+   after being swapped in, writable on its first write.  The copy
+   in D's swap slot is about to go stale, so the slot is released.
+   Does nothing if the page has been evicted meanwhile: the write
+   then faults it back in. */
+void frame_make_writable(struct data *d){
+    uint32_t *pd = thread_current() -> pagedir;
+    lock_acquire(&fl);
+    if(d -> loaded && pagedir_get_page(pd, (void *) d -> upage) == d -> kpage){
+        swap_free(d -> swapIndex);
+        d -> swapIndex = NO_SWAP_SLOT;
+        pagedir_clear_page(pd, (void *) d -> upage);
+        pagedir_set_page(pd, (void *) d -> upage, d -> kpage, true);
+    }
+    lock_release(&fl);
+}
+
+/* Returns true if FE holds a user page that is mapped in its
+   owner's page directory.  A frame that the page fault handler
+   is still filling is not mapped yet, so it is never chosen.
+   Nor is a frame with a futex waiter, which is keyed on it. */
+static bool evictable(struct fte *fe){
+    return (fe ->d != NULL && fe ->pagedir != NULL
+            && pagedir_get_page(fe ->pagedir, fe ->upage) == fe ->frame
+            && !futex_pinned(fe ->frame));
+}
+
+/* Returns true if evicting FE would cost a write, to swap or to
+   its file, rather than just dropping the page.  A page that still
+   has a swap slot is clean: see evict(). */
+static bool needs_write(struct fte *fe){
+    if(fe ->d -> swapIndex != NO_SWAP_SLOT)
+        return false;
+    return (fe ->d -> file == NULL || fe ->d -> dirty
+            || pagedir_is_dirty(fe ->pagedir, fe ->upage));
+}
+
+/* Returns the frame under the clock hand and advances the hand,
+   wrapping around at the end of the frame table. */
+static struct fte *clock_advance(void){
+    if(hand == NULL || hand == list_end(&ft))
+        hand = list_begin(&ft);
+    struct fte *fe = list_entry(hand, struct fte, elem);
+    hand = list_next(hand);
+    return fe;
+}
+
+/* Chooses a frame to evict, or returns NULL if none can be.
+
+   The clock hand gives each page whose accessed bit is set a
+   second chance, clearing the bit as it passes, and stops at the
+   first page that is not accessed and can be dropped without a
+   write.  The first page passed over for needing a write is
+   taken only if two full turns find no such page.
+
+   Under WSClock the hand also passes over pages used within the
+   last WSCLOCK_AGE ticks.  If every page is that recent, the
+   least recently used one is taken. */
+static struct fte *choose_victim(void){
+    int64_t now = timer_ticks();
+    struct fte *dirty = NULL;
+    struct fte *oldest = NULL;
+    size_t n = 2 * list_size(&ft);
+
+    while(n-- > 0){
+        struct fte *fe = clock_advance();
+        if(!evictable(fe))
+            continue;
+        if(pagedir_is_accessed(fe ->pagedir, fe ->upage)){
+            pagedir_set_accessed(fe ->pagedir, fe ->upage, false);
+            fe ->last_used = now;
+            continue;
+        }
+        if(frame_wsclock){
+            if(oldest == NULL || fe ->last_used < oldest ->last_used)
+                oldest = fe;
+            if(now - fe ->last_used <= WSCLOCK_AGE)
+                continue;
+        }
+        if(needs_write(fe)){
+            if(dirty == NULL)
+                dirty = fe;
+            continue;
+        }
+        return fe;
+    }
+    return dirty != NULL ? dirty : oldest;
+}
+
+/* Called by the swap writer once FRAME, evicted to swap, has been
+   written out. */
+static void swap_out_done(void *frame){
+    lock_acquire(&fl);
+    palloc_free_page(frame);
+    swap_outs--;
+    cond_broadcast(&swap_out_finished, &fl);
+    lock_release(&fl);
+}
+
+/* Evicts a page and frees its frame.  Returns false if no frame
+   can be evicted.  Must be called with the frame table lock held,
+   which also holds off a fault on the victim page until it can
+   be brought back.
+
+   How the page is saved depends on where it came from:
+
+     - A clean page read from a file, such as executable code, is
+       simply dropped and re-read from D->file when next touched.
+
+     - A dirty page of a memory-mapped file is written back to
+       the file, after which it is clean again.
+
+     - A page swapped in and not modified since is still in its
+       swap slot, so it is simply dropped.  Such a page is mapped
+       read-only while it holds its slot, and CR0.WP makes even a
+       kernel write to it fault, so any write goes through
+       frame_make_writable() and releases the slot first.
+
+     - Anything else, including a page read from a file and
+       written since, goes to swap.  If it is compressed into RAM
+       its frame is freed at once.  Otherwise the write to disk
+       is only queued here, and the frame is freed by
+       swap_out_done() once it has finished. */
+static bool evict(void){
     struct fte *fe;
-    int pageNo;
-    struct thread *t = thread_current();
-    le = list_next(le);
-    fe = list_entry(le, struct fte, elem);
-
-    int place = memtswap(fe -> frame);
-    fe -> d -> inSwap = true;
-    fe -> d -> swapIndex = place;
-    fe -> d -> loaded = false;
-
-    list_remove(&fe ->elem);
-    pagedir_clear_page(t->pagedir, fe-> d -> upage);
-    palloc_free_page(fe->frame);
+
+    /* Unmap the page before saving it, so that its owner cannot
+       modify it behind our back.  The dirty bit survives.  A
+       futex waiter may have pinned the frame since it was chosen,
+       so check again with interrupts off until it is unmapped. */
+    for(;;){
+        fe = choose_victim();
+        if(fe == NULL)
+            return false;
+        enum intr_level old_level = intr_disable();
+        bool pinned = futex_pinned(fe ->frame);
+        if(!pinned)
+            pagedir_clear_page(fe ->pagedir, fe ->upage);
+        intr_set_level(old_level);
+        if(!pinned)
+            break;
+    }
+    struct data *d = fe ->d;
+
+    TRACE (EVICT, d -> upage, fe -> frame);
+
+    bool dirty = pagedir_is_dirty(fe ->pagedir, fe ->upage);
+    if(dirty)
+        d -> dirty = true;
+
+    if(d -> file != NULL && !d -> dirty){
+        /* Nothing to save. */
+        palloc_free_page(fe->frame);
+    }else if(d -> file != NULL && d -> mapped){
+        file_write_at(d -> file, fe -> frame, d -> page_read_bytes, d -> ofs);
+        d -> dirty = false;
+        palloc_free_page(fe->frame);
+    }else if(d -> swapIndex != NO_SWAP_SLOT){
+        /* Unchanged since it was swapped in: its slot still holds
+           it. */
+        ASSERT(!dirty);
+        d -> inSwap = true;
+        palloc_free_page(fe->frame);
+    }else{
+        bool queued;
+        d -> swapIndex = memtswap(fe -> frame, swap_out_done, &queued);
+        d -> inSwap = true;
+        if(queued)
+            swap_outs++;
+        else
+            palloc_free_page(fe->frame);
+    }
+    d -> loaded = false;
+
+    remove_frame(fe);
     free(fe);
-    return;
-}
\ No newline at end of file
+    return true;
+}
@@ -19,14 +19,25 @@
 #include "threads/synch.h"
 #include "vm/page.h"
 
+/* A frame table entry: one frame obtained through get_frame(). */
 struct fte {
     struct list_elem elem;
     void* frame;
-    struct data *d;
+    struct data *d;         /* Page held, or NULL if not evictable. */
+    uint32_t *pagedir;      /* Owner's page directory. */
+    void *upage;            /* User address the frame is mapped at. */
+    int64_t last_used;      /* Tick the page was last seen accessed. */
 };
 
+/* If false (default), evict with the clock algorithm.
+   If true, evict with WSClock.
+   Controlled by kernel command-line option "-wsclock". */
+extern bool frame_wsclock;
+
 void frame_init();
 void * get_frame(enum palloc_flags flags, struct data *d);
+void * get_shared_frame(void);
 void frame_free(void *frame);
+void frame_free_pagedir(uint32_t *pd);
+void frame_make_writable(struct data *d);
 void add_frame(struct fte *e);
-void evict();
@@ -1,4 +1,8 @@
 #include "page.h"
+#include "swap.h"
+#include "share.h"
+#include "threads/malloc.h"
+#include "userprog/pagedir.h"
 
 /** 
  * @brief We pass this as a function pointer to routines in the hash api that work with ordering
@@ -26,6 +30,33 @@ bool spt_init(struct hash *spt){
     return 1;
 }
 
+/* Frees the page record in E, releasing its swap slot. */
+static void spte_destroy(struct hash_elem *e, void *aux UNUSED){
+    struct spte *f = hash_entry(e, struct spte, hash_elem);
+    if(f ->d ->swapIndex != NO_SWAP_SLOT)
+        swap_free(f ->d ->swapIndex);
+    free(f ->d);
+    free(f);
+}
+
+/* Destroys SPT when its process, with page directory PD, exits,
+   freeing every page record and the swap slots they hold.  Shared
+   pages are unmapped from PD first, so that pagedir_destroy()
+   leaves their frames to the processes still using them. */
+void spt_destroy(struct hash *spt, uint32_t *pd){
+    struct hash_iterator i;
+
+    hash_first(&i, spt);
+    while(hash_next(&i)){
+        struct data *d = hash_entry(hash_cur(&i), struct spte, hash_elem) ->d;
+        if(d ->share != NULL){
+            pagedir_clear_page(pd, (void *) d ->upage);
+            share_unmap(d);
+        }
+    }
+    hash_destroy(spt, spte_destroy);
+}
+
 bool spt_put(struct hash *spt, int page_number, struct data *d){
     struct spte *e = calloc(1, sizeof(struct spte));
     e ->key = page_number;
@@ -75,6 +106,10 @@ bool add_data(struct file *file, int32_t ofs, uint32_t upage, uint32_t page_read
     d ->writable = writable;
     d ->loaded = loaded;
     d ->inSwap = false;
+    d ->swapIndex = NO_SWAP_SLOT;
+    d ->dirty = false;
+    d ->mapped = false;
+    d ->share = NULL;
 
     return(spt_put(&thread_current() -> spt, upage, d));
 }
\ No newline at end of file
@@ -28,7 +28,10 @@ struct data{
     bool writable;
     uint8_t * kpage;
     bool inSwap;
-    int swapIndex;
+    int swapIndex;  /* Swap slot holding a copy, or NO_SWAP_SLOT. */
+    bool dirty;     /* Written since read from FILE: swap, don't drop. */
+    bool mapped;    /* Page of a memory-mapped FILE: write back to it. */
+    struct shared_page *share;  /* Shared frame mapped, or NULL. */
 };
 
 struct spte {   
@@ -42,6 +45,7 @@ struct spte {
     struct data *d; ///< The payload - could be a struct
 };
 bool spt_init(struct hash *spt);
+void spt_destroy(struct hash *spt, uint32_t *pd);
 bool spt_put(struct hash *spt,int page_number, struct data *d);
 struct data* spt_get(struct hash *spt,int page_number);
 bool add_data(struct file *file, int32_t ofs, uint32_t upage, uint32_t page_read_bytes, uint32_t page_zero_bytes, bool writable, bool loaded);
@@ -0,0 +1,117 @@
+#include "share.h"
+#include <debug.h>
+#include <hash.h>
+#include <stdint.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "frame.h"
+
+/* A read-only page of an executable, mapped by every process
+   that runs it. */
+struct shared_page {
+    struct hash_elem elem;      /* Element in shared_pages. */
+    struct inode *inode;        /* Executable, held open. */
+    uint32_t ofs;               /* Offset of the page in INODE. */
+    uint32_t read_bytes;        /* Bytes read from INODE, rest zero. */
+    void *frame;                /* Frame holding the page. */
+    int refs;                   /* Pages mapping FRAME. */
+};
+
+/* Shared pages, keyed by executable, offset and length. */
+static struct hash shared_pages;
+
+/* Protects shared_pages. */
+static struct lock sl;
+
+static unsigned shared_page_hash(const struct hash_elem *e, void *aux UNUSED){
+    const struct shared_page *sp = hash_entry(e, struct shared_page, elem);
+    return (hash_int((int) (uintptr_t) sp ->inode) ^ hash_int(sp ->ofs)
+            ^ hash_int(sp ->read_bytes));
+}
+
+static bool shared_page_less(const struct hash_elem *a_,
+                             const struct hash_elem *b_, void *aux UNUSED){
+    const struct shared_page *a = hash_entry(a_, struct shared_page, elem);
+    const struct shared_page *b = hash_entry(b_, struct shared_page, elem);
+    if(a ->inode != b ->inode)
+        return (uintptr_t) a ->inode < (uintptr_t) b ->inode;
+    if(a ->ofs != b ->ofs)
+        return a ->ofs < b ->ofs;
+    return a ->read_bytes < b ->read_bytes;
+}
+
+void share_init(void){
+    hash_init(&shared_pages, shared_page_hash, shared_page_less, NULL);
+    lock_init(&sl);
+    lock_set_name(&sl, "shared pages");
+}
+
+/* Returns the frame holding the read-only executable page D,
+   reading it from D->file if no other process has it mapped, and
+   records the mapping in D.  Returns NULL if memory runs out or
+   the read fails. */
+void *share_map(struct data *d){
+    struct shared_page key, *sp;
+    struct hash_elem *e;
+
+    ASSERT(d ->file != NULL && !d ->writable);
+
+    key.inode = file_get_inode(d ->file);
+    key.ofs = d ->ofs;
+    key.read_bytes = d ->page_read_bytes;
+    lock_acquire(&sl);
+    e = hash_find(&shared_pages, &key.elem);
+    if(e != NULL){
+        sp = hash_entry(e, struct shared_page, elem);
+        sp ->refs++;
+    }else{
+        sp = malloc(sizeof *sp);
+        if(sp == NULL){
+            lock_release(&sl);
+            return NULL;
+        }
+        sp ->frame = get_shared_frame();
+        if(sp ->frame == NULL
+           || file_read_at(d ->file, sp ->frame, d ->page_read_bytes, d ->ofs)
+              != (int) d ->page_read_bytes){
+            if(sp ->frame != NULL)
+                frame_free(sp ->frame);
+            free(sp);
+            lock_release(&sl);
+            return NULL;
+        }
+        memset((uint8_t *) sp ->frame + d ->page_read_bytes, 0,
+               d ->page_zero_bytes);
+        sp ->inode = inode_reopen(key.inode);
+        sp ->ofs = key.ofs;
+        sp ->read_bytes = key.read_bytes;
+        sp ->refs = 1;
+        hash_insert(&shared_pages, &sp ->elem);
+    }
+    lock_release(&sl);
+
+    d ->share = sp;
+    return sp ->frame;
+}
+
+/* Drops D's mapping of its shared page, which the caller has
+   already removed from D's page directory, and frees the frame
+   once no process maps it. */
+void share_unmap(struct data *d){
+    struct shared_page *sp = d ->share;
+
+    ASSERT(sp != NULL);
+
+    lock_acquire(&sl);
+    if(--sp ->refs == 0){
+        hash_delete(&shared_pages, &sp ->elem);
+        inode_close(sp ->inode);
+        frame_free(sp ->frame);
+        free(sp);
+    }
+    lock_release(&sl);
+    d ->share = NULL;
+}
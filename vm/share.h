@@ -0,0 +1,18 @@
+#ifndef VM_SHARE_H
+#define VM_SHARE_H
+
+#include "vm/page.h"
+
+/* Shared executable pages.
+
+   The read-only pages of an executable are the same in every
+   process that runs it, so they are read once into a frame that
+   all of those processes map.  A shared frame belongs to no
+   process and is never evicted; it is freed when the last
+   process that maps it exits. */
+
+void share_init(void);
+void *share_map(struct data *d);
+void share_unmap(struct data *d);
+
+#endif /* vm/share.h */
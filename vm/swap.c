@@ -1,36 +1,162 @@
 #include "swap.h"
+#include "threads/malloc.h"
+#include "threads/trace.h"
+#include "vm/zswap.h"
+
+/* Sectors per page-sized swap slot. */
+#define SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* A page on its way out to swap.  The frame stays allocated, and
+   keeps the page's contents, until the write has finished. */
+struct swap_write {
+    struct list_elem elem;      /* Element in swap_writes. */
+    void *frame;                /* Page to write out. */
+    int slot;                   /* Swap slot to write it to. */
+    swap_done_func *done;       /* Called once it is written. */
+};
 
 struct lock sl;
 struct block *sb;
 struct bitmap *st;
-int SECTORS = 8;
+
+/* Swap slots below disk_slots are on the swap device.  The
+   ZSWAP_SLOTS slots above them are pages kept compressed in RAM
+   by the zswap tier, which is tried first. */
+static size_t disk_slots;
+
+/* Reference count of each swap slot: one for the page record
+   that has the slot, and one while it is being written.  A disk
+   slot is set in st as long as its count is nonzero.  Protected
+   by sl. */
+static uint8_t *slot_refs;
+
+/* Writes queued or in progress, oldest first.  Protected by sl,
+   which is never held across I/O. */
+static struct list swap_writes;
+static struct condition swap_queued;
+
+static thread_func swap_writer NO_RETURN;
+
 void swap_init(void){
     lock_init(&sl);
+    lock_set_name(&sl, "swap table");
+    list_init(&swap_writes);
+    cond_init(&swap_queued);
     sb = block_get_role(BLOCK_SWAP);
-    int size = block_size(sb);
-    size /= SECTORS;
-    st = bitmap_create(size);
-    bitmap_set_all(st, 0);
+    disk_slots = sb != NULL ? block_size(sb) / SECTORS : 0;
+    st = bitmap_create(disk_slots);
+    slot_refs = calloc(disk_slots + ZSWAP_SLOTS, sizeof *slot_refs);
+    if(st == NULL || slot_refs == NULL){
+        PANIC("SWAP TABLE OUT OF MEMORY");
+    }
+    zswap_init();
+    thread_create("swap-writer", PRI_DEFAULT + 1, swap_writer, NULL);
 }
 
-int memtswap(void* frame){
+/* Saves FRAME to a free swap slot and returns the slot.  The
+   caller owns a reference to the slot, to be dropped with
+   swap_free().
+
+   If the zswap tier takes the page, it is saved by the time this
+   returns, *QUEUED is set to false and FRAME may be reused at
+   once.  Otherwise FRAME is queued to be written to the swap
+   device and *QUEUED is set to true: this returns as soon as the
+   write is queued, and DONE is called with FRAME, from the swap
+   writer thread, once the frame may be reused. */
+int memtswap(void* frame, swap_done_func *done, bool *queued){
+    int zindex = zswap_store(frame);
+    if(zindex >= 0){
+        TRACE (SWAP_OUT, frame, disk_slots + zindex);
+        lock_acquire(&sl);
+        slot_refs[disk_slots + zindex] = 1;
+        lock_release(&sl);
+        *queued = false;
+        return disk_slots + zindex;
+    }
+
+    struct swap_write *w = malloc(sizeof *w);
+    if(w == NULL){
+        PANIC("SWAP OUT OF MEMORY");
+    }
     lock_acquire(&sl);
     int freeIndex = bitmap_scan_and_flip(st, 0, 1, 0);
     if(freeIndex == BITMAP_ERROR){
         PANIC("SWAP FULL");
     }
-    for(int i = 0; i < SECTORS; i++){
-        block_write(sb, freeIndex * SECTORS + i, (uint8_t*)frame + SECTORS * i);
-    }
+    TRACE (SWAP_OUT, frame, freeIndex);
+    slot_refs[freeIndex] = 2;
+    w ->frame = frame;
+    w ->slot = freeIndex;
+    w ->done = done;
+    list_push_back(&swap_writes, &w ->elem);
+    cond_signal(&swap_queued, &sl);
     lock_release(&sl);
+    *queued = true;
     return freeIndex;
 }
 
+/* Reads swap slot INDEX into FRAME.  If the slot's write is still
+   queued or in progress, the page is copied from the frame being
+   written instead, so a swap-in waits only for its own read.
+   The slot keeps its contents, so a page that is still clean
+   when evicted again need not be written out again. */
 void swaptmem(void* frame, int index){
+    struct list_elem *e;
+
+    TRACE (SWAP_IN, frame, index);
+    if((size_t) index >= disk_slots){
+        zswap_load(index - disk_slots, frame);
+        return;
+    }
     lock_acquire(&sl);
-    for(int i = 0; i < SECTORS; i++){
-        block_read(sb, index * SECTORS + i, (uint8_t)frame + i * BLOCK_SECTOR_SIZE);
+    for(e = list_begin(&swap_writes); e != list_end(&swap_writes); e = list_next(e)){
+        struct swap_write *w = list_entry(e, struct swap_write, elem);
+        if(w ->slot == index){
+            memcpy(frame, w ->frame, PGSIZE);
+            lock_release(&sl);
+            return;
+        }
     }
     lock_release(&sl);
-    return true;
+    block_read_sectors(sb, index * SECTORS, SECTORS, frame);
+}
+
+/* Drops a reference to swap slot INDEX, freeing the slot once no
+   page record or write uses it. */
+void swap_free(int index){
+    bool in_zswap = (size_t) index >= disk_slots;
+    bool freed;
+
+    lock_acquire(&sl);
+    ASSERT(slot_refs[index] > 0);
+    freed = --slot_refs[index] == 0;
+    if(freed && !in_zswap)
+        bitmap_reset(st, index);
+    lock_release(&sl);
+    if(freed && in_zswap)
+        zswap_free(index - disk_slots);
+}
+
+/* Swap writer thread: writes queued pages out one page-sized
+   request at a time.  A write stays on swap_writes while it is in
+   progress so that swaptmem() can still find it. */
+static void swap_writer(void *aux UNUSED){
+    for(;;){
+        struct swap_write *w;
+
+        lock_acquire(&sl);
+        while(list_empty(&swap_writes))
+            cond_wait(&swap_queued, &sl);
+        w = list_entry(list_front(&swap_writes), struct swap_write, elem);
+        lock_release(&sl);
+
+        block_write_sectors(sb, w ->slot * SECTORS, SECTORS, w ->frame);
+
+        lock_acquire(&sl);
+        list_remove(&w ->elem);
+        lock_release(&sl);
+        swap_free(w ->slot);
+        w ->done(w ->frame);
+        free(w);
+    }
 }
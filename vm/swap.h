@@ -1,3 +1,6 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
@@ -23,8 +26,19 @@
 
 #include "devices/block.h"
 
+/* Swap slot index meaning "no slot". */
+#define NO_SWAP_SLOT (-1)
+
+/* Called with a frame passed to memtswap() once its page has been
+   written to swap and the frame may be reused. */
+typedef void swap_done_func (void *frame);
+
 void swap_init(void);
 
-int memtswap(void* frame);
+int memtswap(void* frame, swap_done_func *done, bool *queued);
 
 void swaptmem(void* frame, int index);
+
+void swap_free(int index);
+
+#endif /* vm/swap.h */
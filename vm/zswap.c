@@ -0,0 +1,183 @@
+#include "zswap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <lz.h>
+#include <list.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Most kernel pages the compressed pool may take. */
+#define ZSWAP_POOL_PAGES 64
+
+/* A pool page.  Like Linux's zbud, it holds up to two compressed
+   pages ("buddies"): the first packed right after this header,
+   the last packed against the end of the page. */
+struct zpage {
+    struct list_elem elem;      /* Element in unbuddied, if one is free. */
+    uint16_t first;             /* Size of first buddy, 0 if free. */
+    uint16_t last;              /* Size of last buddy, 0 if free. */
+};
+
+/* Largest compressed page the pool can hold. */
+#define ZPAGE_CAPACITY (PGSIZE - sizeof (struct zpage))
+
+/* A page held by the tier. */
+struct zswap_entry {
+    uint8_t *data;              /* Compressed page, or NULL if same-filled. */
+    uint32_t fill;              /* Repeated word, if same-filled. */
+    uint16_t size;              /* Compressed size in bytes. */
+};
+
+static struct zswap_entry entries[ZSWAP_SLOTS];
+static struct bitmap *used;     /* Entries in use. */
+
+/* Pool pages with a free buddy. */
+static struct list unbuddied;
+static int pool_pages;
+
+/* Compression scratch space. */
+static uint8_t zbuf[ZPAGE_CAPACITY];
+static uint8_t zwork[LZ_WORK_SIZE];
+
+/* Statistics. */
+static long long stored_cnt;    /* Pages compressed into the pool. */
+static long long filled_cnt;    /* Same-filled pages. */
+static long long reject_cnt;    /* Pages left for the swap device. */
+
+/* Protects everything above. */
+static struct lock zl;
+
+void zswap_init(void){
+    lock_init(&zl);
+    lock_set_name(&zl, "zswap");
+    list_init(&unbuddied);
+    used = bitmap_create(ZSWAP_SLOTS);
+    if(used == NULL){
+        PANIC("ZSWAP OUT OF MEMORY");
+    }
+}
+
+/* Returns space for SIZE bytes of compressed data in the pool, or
+   NULL if the pool is full. */
+static uint8_t *zpool_alloc(size_t size){
+    struct list_elem *e;
+    struct zpage *zp;
+
+    for(e = list_begin(&unbuddied); e != list_end(&unbuddied); e = list_next(e)){
+        zp = list_entry(e, struct zpage, elem);
+        if(ZPAGE_CAPACITY - zp ->first - zp ->last >= size){
+            list_remove(&zp ->elem);
+            if(zp ->first == 0){
+                zp ->first = size;
+                return (uint8_t *) (zp + 1);
+            }
+            zp ->last = size;
+            return (uint8_t *) zp + PGSIZE - size;
+        }
+    }
+
+    if(pool_pages >= ZSWAP_POOL_PAGES)
+        return NULL;
+    zp = palloc_get_page(0);
+    if(zp == NULL)
+        return NULL;
+    pool_pages++;
+    zp ->first = size;
+    zp ->last = 0;
+    list_push_back(&unbuddied, &zp ->elem);
+    return (uint8_t *) (zp + 1);
+}
+
+/* Frees compressed data DATA, returning its pool page to the
+   kernel pool once both of its buddies are free. */
+static void zpool_free(uint8_t *data){
+    struct zpage *zp = pg_round_down(data);
+    bool was_full = zp ->first != 0 && zp ->last != 0;
+
+    if(data == (uint8_t *) (zp + 1))
+        zp ->first = 0;
+    else
+        zp ->last = 0;
+
+    if(zp ->first == 0 && zp ->last == 0){
+        if(!was_full)
+            list_remove(&zp ->elem);
+        palloc_free_page(zp);
+        pool_pages--;
+    }else if(was_full)
+        list_push_back(&unbuddied, &zp ->elem);
+}
+
+/* Stores PAGE in the tier and returns its index, or -1 if the
+   tier is full or PAGE does not compress into a pool buddy. */
+int zswap_store(const void *page){
+    const uint32_t *w = page;
+    size_t i, e, size;
+
+    for(i = 1; i < PGSIZE / sizeof *w && w[i] == w[0]; i++)
+        continue;
+
+    lock_acquire(&zl);
+    e = bitmap_scan_and_flip(used, 0, 1, false);
+    if(e == BITMAP_ERROR)
+        goto reject;
+
+    if(i == PGSIZE / sizeof *w){
+        entries[e].data = NULL;
+        entries[e].fill = w[0];
+        filled_cnt++;
+    }else{
+        size = lz_compress(page, PGSIZE, zbuf, sizeof zbuf, zwork);
+        if(size == 0 || (entries[e].data = zpool_alloc(size)) == NULL){
+            bitmap_reset(used, e);
+            goto reject;
+        }
+        memcpy(entries[e].data, zbuf, size);
+        entries[e].size = size;
+        stored_cnt++;
+    }
+    lock_release(&zl);
+    return e;
+
+ reject:
+    reject_cnt++;
+    lock_release(&zl);
+    return -1;
+}
+
+/* Copies page INDEX, which stays in the tier, into PAGE. */
+void zswap_load(int index, void *page){
+    struct zswap_entry *z = &entries[index];
+
+    lock_acquire(&zl);
+    ASSERT(bitmap_test(used, index));
+    if(z ->data == NULL){
+        uint32_t *w = page;
+        size_t i;
+        for(i = 0; i < PGSIZE / sizeof *w; i++)
+            w[i] = z ->fill;
+    }else if(lz_decompress(z ->data, z ->size, page, PGSIZE) != PGSIZE)
+        PANIC("zswap: corrupt page %d", index);
+    lock_release(&zl);
+}
+
+/* Removes page INDEX from the tier. */
+void zswap_free(int index){
+    lock_acquire(&zl);
+    ASSERT(bitmap_test(used, index));
+    if(entries[index].data != NULL)
+        zpool_free(entries[index].data);
+    bitmap_reset(used, index);
+    lock_release(&zl);
+}
+
+/* Prints compressed swap statistics. */
+void zswap_print_stats(void){
+    printf("Zswap: %lld pages compressed, %lld same-filled, "
+           "%lld sent to disk, %d pool pages\n",
+           stored_cnt, filled_cnt, reject_cnt, pool_pages);
+}
@@ -0,0 +1,22 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+
+#include <stdbool.h>
+
+/* Compressed in-memory swap.
+
+   Evicted pages are compressed into a small pool of kernel pages
+   before falling back to the swap device, so that compressible
+   pages cost a compression instead of disk I/O.  A page filled
+   with a single repeated word is kept as just that word. */
+
+/* Most pages the tier holds at once. */
+#define ZSWAP_SLOTS 1024
+
+void zswap_init(void);
+int zswap_store(const void *page);
+void zswap_load(int index, void *page);
+void zswap_free(int index);
+void zswap_print_stats(void);
+
+#endif /* vm/zswap.h */